@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Deflate.hpp"
+#include <string>
+#include <sys/types.h>
+
+class BodySource
+{
+  public:
+	virtual ~BodySource() {}
+	virtual bool produce(std::string &out, size_t max) = 0;
+};
+
+class StringSource : public BodySource
+{
+  public:
+	StringSource(const std::string &data);
+	bool produce(std::string &out, size_t max);
+
+  private:
+	std::string _data;
+	size_t _offset;
+};
+
+class StreamSource : public BodySource
+{
+  public:
+	StreamSource();
+	void append(const std::string &data);
+	void close();
+	size_t buffered() const;
+	bool produce(std::string &out, size_t max);
+
+  private:
+	std::string _data;
+	bool _closed;
+};
+
+class FileSource : public BodySource
+{
+  public:
+	FileSource(int fd, off_t length);
+	~FileSource();
+	bool produce(std::string &out, size_t max);
+
+  private:
+	int _fd;
+	off_t _remaining;
+	FileSource(const FileSource &);
+	FileSource &operator=(const FileSource &);
+};
+
+class BodyEncoder
+{
+  public:
+	virtual ~BodyEncoder() {}
+	virtual void encode(const char *data, size_t len, std::string &out) = 0;
+	virtual void finish(std::string &out) = 0;
+};
+
+class ChunkedEncoder : public BodyEncoder
+{
+  public:
+	void encode(const char *data, size_t len, std::string &out);
+	void finish(std::string &out);
+};
+
+class DeflateEncoder : public BodyEncoder
+{
+  public:
+	DeflateEncoder(Deflater::Format format);
+	void encode(const char *data, size_t len, std::string &out);
+	void finish(std::string &out);
+
+  private:
+	Deflater _deflater;
+};
@@ -2,11 +2,13 @@
 
 #include <cctype>
 #include <cerrno>
+#include <climits>
 #include <cstdlib>
 #include <cstring>
 #include <fcntl.h>
 #include <iostream>
 #include <signal.h>
+#include <spawn.h>
 #include <sstream>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -25,29 +27,68 @@
 class CGI
 {
 public:
-	CGI(const HttpRequest &request, const LocationConfig &location);
+	CGI(const HttpRequest &request, const LocationConfig &location,
+		const std::string &remote_addr);
 	~CGI();
-	std::string execute(const std::string &script_path);
+	bool start(const std::string &script_path);
+	void startRemote(const std::string &script_path);
+	void appendOutput(const char *data, size_t len);
+	void fail(int code, const std::string &message);
+	bool writeInput();
+	bool readOutput(size_t limit);
+	bool parseHead();
+	const std::string &getHead() const;
+	bool hasContentLength() const;
+	std::string takeOutput();
+	size_t getOutputSize() const;
+	bool hasFailed() const;
+	void closeInput();
+	void closeOutput();
+	void setExitStatus(int status);
+	void terminate();
+	bool isComplete() const;
+	bool hasTimedOut(time_t now) const;
+	std::string getResponse();
+	int getInputFd() const;
+	int getOutputFd() const;
+	pid_t getPid() const;
+	const HttpRequest &getRequest() const;
+	char *const *getEnvironment() const;
+	const LocationConfig &getLocation() const;
 	void setTimeout(time_t seconds)
 	{
 		timeout_seconds_ = seconds;
 	}
 
 private:
-	const HttpRequest &request_;
+	HttpRequest request_;
 	const LocationConfig &location_;
-	std::map<std::string, std::string> env_map_;
-	std::vector<char *> env_vars_;
+	std::string env_;
+	std::vector<char *> envp_;
 	time_t timeout_seconds_;
-	void setupEnvironment();
+	time_t activity_time_;
+	pid_t pid_;
+	int input_fd_;
+	int output_fd_;
+	size_t input_offset_;
+	int body_fd_;
+	std::string input_buffer_;
+	std::string output_;
+	bool head_parsed_;
+	std::string head_;
+	bool head_has_length_;
+	bool exited_;
+	int exit_status_;
+	int error_code_;
+	std::string error_message_;
+	bool fillInput();
+	void setupEnvironment(const std::string &remote_addr);
+	void addVariable(const char *name, const std::string &value);
 	void buildEnvArray();
-	void executeCGIChild(const std::string &script_path, int pipe_in[2],
-						 int pipe_out[2]);
-	std::string handleCGIParent(pid_t pid, int pipe_in[2], int pipe_out[2]);
 	std::string parseCGIOutput(const std::string &raw_output);
+	std::string buildHead(const std::string &headers);
 	std::string generateErrorResponse(int code, const std::string &message);
 	std::string getDirectoryPath(const std::string &file_path);
-	std::string toUpperSnakeCase(const std::string &str);
 	std::string toString(int num);
 	std::string getStatusMessage(int code);
 	CGI(const CGI &);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+class CGICache
+{
+  public:
+	enum Result
+	{
+		MISS,
+		HIT,
+		STALE,
+		PASS
+	};
+	CGICache(size_t max_bytes, size_t max_entry);
+	~CGICache();
+	Result lookup(const std::string &key, time_t now, std::string &response, time_t &age);
+	void store(const std::string &key, const std::string &response, time_t now);
+	void pass(const std::string &key, time_t now);
+	bool lock(const std::string &key);
+	void wait(const std::string &key, int client_fd);
+	void cancel(const std::string &key, int client_fd);
+	void unlock(const std::string &key, std::vector<int> &waiters);
+	size_t maxEntry() const;
+
+  private:
+	struct Entry
+	{
+		std::string response;
+		size_t size;
+		time_t stored;
+		time_t fresh_until;
+		time_t stale_until;
+		bool pass;
+		unsigned long used;
+	};
+	std::map<std::string, Entry> _entries;
+	std::map<std::string, std::vector<int> > _locks;
+	size_t _bytes;
+	size_t _max_bytes;
+	size_t _max_entry;
+	unsigned long _tick;
+	void erase(std::map<std::string, Entry>::iterator it);
+	void evict(size_t needed);
+	CGICache(const CGICache &);
+	CGICache &operator=(const CGICache &);
+};
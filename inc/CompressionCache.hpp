@@ -0,0 +1,54 @@
+#pragma once
+
+#include "BodyStream.hpp"
+#include <ctime>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+
+class CompressionCache
+{
+  public:
+	CompressionCache(size_t max_bytes, size_t max_entry);
+	~CompressionCache();
+	const std::string *find(const std::string &path, const std::string &encoding,
+		const struct stat &info);
+	void store(const std::string &path, const std::string &encoding, time_t mtime,
+		off_t size, const std::string &data);
+	size_t maxEntry() const;
+
+  private:
+	struct Entry
+	{
+		time_t mtime;
+		off_t size;
+		std::string data;
+		unsigned long used;
+	};
+	std::map<std::string, Entry> _entries;
+	size_t _bytes;
+	size_t _max_bytes;
+	size_t _max_entry;
+	unsigned long _tick;
+	void evict(size_t needed);
+	CompressionCache(const CompressionCache &);
+	CompressionCache &operator=(const CompressionCache &);
+};
+
+class CacheFillEncoder : public BodyEncoder
+{
+  public:
+	CacheFillEncoder(CompressionCache &cache, const std::string &path,
+		const std::string &encoding, const struct stat &info);
+	void encode(const char *data, size_t len, std::string &out);
+	void finish(std::string &out);
+
+  private:
+	CompressionCache &_cache;
+	std::string _path;
+	std::string _encoding;
+	time_t _mtime;
+	off_t _size;
+	std::string _captured;
+	bool _overflow;
+};
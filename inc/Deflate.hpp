@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+class Deflater
+{
+  public:
+	enum Format
+	{
+		GZIP,
+		ZLIB
+	};
+	Deflater(Format format);
+	~Deflater();
+	void compress(const char *data, size_t len, std::string &out);
+	void finish(std::string &out);
+
+  private:
+	Format _format;
+	bool _header_done;
+	bool _finished;
+	unsigned long _crc;
+	unsigned long _adler;
+	unsigned long _total_in;
+	std::string _window;
+	size_t _history;
+	unsigned long _bit_buffer;
+	int _bit_count;
+	std::vector<int> _head;
+	std::vector<int> _prev;
+	std::vector<unsigned short> _symbols;
+	std::vector<unsigned short> _extras;
+	void writeHeader(std::string &out);
+	void compressPending(bool final, std::string &out);
+	void emitBlock(bool final, std::string &out);
+	void putBits(unsigned long value, int count, std::string &out);
+	void flushBits(std::string &out);
+	void updateChecksums(const char *data, size_t len);
+	Deflater(const Deflater &);
+	Deflater &operator=(const Deflater &);
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "BodyStream.hpp"
+#include <ctime>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <vector>
+
+struct DirectoryEntry
+{
+	std::string name;
+	bool is_dir;
+	off_t size;
+	time_t mtime;
+};
+
+class DirectorySnapshot
+{
+  public:
+	DirectorySnapshot();
+	bool load(int dir_fd, const struct stat &info);
+	void retain();
+	void release();
+	bool isCurrent(const struct stat &info) const;
+	const std::vector<DirectoryEntry> &entries() const;
+	const std::vector<size_t> &order(const std::string &sort);
+
+  private:
+	int _refs;
+	time_t _mtime;
+	long _mtime_nsec;
+	ino_t _inode;
+	std::vector<DirectoryEntry> _entries;
+	std::map<std::string, std::vector<size_t> > _orders;
+	~DirectorySnapshot();
+	DirectorySnapshot(const DirectorySnapshot &);
+	DirectorySnapshot &operator=(const DirectorySnapshot &);
+};
+
+class DirectoryCache
+{
+  public:
+	DirectoryCache(size_t max_directories);
+	~DirectoryCache();
+	DirectorySnapshot *acquire(const std::string &path, int dir_fd, const struct stat &info);
+
+  private:
+	struct Slot
+	{
+		DirectorySnapshot *snapshot;
+		unsigned long used;
+	};
+	std::map<std::string, Slot> _slots;
+	size_t _max_directories;
+	unsigned long _tick;
+	DirectoryCache(const DirectoryCache &);
+	DirectoryCache &operator=(const DirectoryCache &);
+};
+
+struct ListingOptions
+{
+	std::string uri;
+	std::string sort;
+	bool descending;
+	size_t page;
+	size_t limit;
+	bool json;
+};
+
+ListingOptions parseListingOptions(const std::string &uri, const std::string &query,
+	bool json);
+
+class DirectoryListingSource : public BodySource
+{
+  public:
+	DirectoryListingSource(DirectorySnapshot *snapshot, const ListingOptions &options);
+	~DirectoryListingSource();
+	bool produce(std::string &out, size_t max);
+
+  private:
+	enum Stage
+	{
+		HEADER,
+		ROWS,
+		FOOTER,
+		DONE
+	};
+	DirectorySnapshot *_snapshot;
+	ListingOptions _options;
+	Stage _stage;
+	size_t _begin;
+	size_t _next;
+	size_t _end;
+	size_t _pages;
+	std::string pageLink(size_t page) const;
+	std::string sortLink(const std::string &sort) const;
+	void writeHeader(std::string &out) const;
+	void writeRow(const DirectoryEntry &entry, std::string &out) const;
+	void writeFooter(std::string &out) const;
+	void writeJsonHeader(std::string &out) const;
+	void writeJsonRow(const DirectoryEntry &entry, std::string &out) const;
+	DirectoryListingSource(const DirectoryListingSource &);
+	DirectoryListingSource &operator=(const DirectoryListingSource &);
+};
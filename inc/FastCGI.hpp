@@ -0,0 +1,76 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+class CGI;
+
+class FastCGIClient
+{
+  public:
+	FastCGIClient();
+	~FastCGIClient();
+	void manage(const std::string &address, const std::string &interpreter,
+		const std::string &worker, size_t idle, size_t max, size_t requests);
+	void submit(const std::string &address, int client_fd, CGI *cgi);
+	void cancel(CGI *cgi);
+	void handleEvent(int fd, short revents);
+	void takeCompleted(std::vector<int> &completed);
+	void pollFds(std::map<int, short> &fds) const;
+
+  private:
+	struct Stream
+	{
+		int client_fd;
+		CGI *cgi;
+		bool received;
+		bool retried;
+		size_t input_offset;
+		bool input_done;
+	};
+	struct Pool
+	{
+		std::string interpreter;
+		std::string worker;
+		size_t idle;
+		size_t max;
+		size_t requests;
+	};
+	struct Connection
+	{
+		int fd;
+		pid_t pid;
+		size_t served;
+		std::string address;
+		bool connecting;
+		std::string out;
+		std::string in;
+		std::map<unsigned short, Stream> streams;
+		size_t max_streams;
+		unsigned short next_id;
+	};
+	std::map<std::string, Pool> _pools;
+	std::map<int, Connection *> _connections;
+	std::map<std::string, std::deque<Stream> > _pending;
+	std::map<CGI *, std::pair<Connection *, unsigned short> > _active;
+	std::vector<int> _completed;
+	Connection *open(const std::string &address);
+	Connection *spawn(const std::string &address, const Pool &pool);
+	Connection *acquire(const std::string &address);
+	void dispatch(const std::string &address);
+	void beginRequest(Connection *conn, const Stream &stream);
+	void feedInput(Connection *conn);
+	bool flush(Connection *conn);
+	bool receive(Connection *conn);
+	void handleRecord(Connection *conn, unsigned char type, unsigned short id,
+		const std::string &content);
+	void finishStream(Connection *conn, unsigned short id, int code,
+		const std::string &message);
+	void closeConnection(Connection *conn);
+	void trimIdle(const std::string &address);
+	FastCGIClient(const FastCGIClient &);
+	FastCGIClient &operator=(const FastCGIClient &);
+};
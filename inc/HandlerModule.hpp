@@ -0,0 +1,33 @@
+#pragma once
+
+#include "BodyStream.hpp"
+#include "HttpRequest.hpp"
+#include "HttpResponse.hpp"
+#include "webserv_module.h"
+#include <ctime>
+#include <string>
+#include <sys/types.h>
+
+class HandlerModule
+{
+  public:
+	HandlerModule(const std::string &path);
+	~HandlerModule();
+	bool load();
+	void refresh(time_t now);
+	bool handle(const HttpRequest &request, const std::string &remote_addr,
+		HttpResponse &response, StreamSource &body);
+	const std::string &getError() const;
+
+  private:
+	std::string _path;
+	void *_handle;
+	const webserv_module *_module;
+	time_t _mtime;
+	ino_t _inode;
+	time_t _checked;
+	std::string _error;
+	void unload();
+	HandlerModule(const HandlerModule &);
+	HandlerModule &operator=(const HandlerModule &);
+};
@@ -5,6 +5,7 @@
 #include <sstream>
 #include <algorithm>
 #include <cctype>
+#include <unistd.h>
 
 class HttpRequest
 {
@@ -15,6 +16,9 @@ class HttpRequest
 	const std::string &getUri() const;
 	const std::string &getHttpVersion() const;
 	const std::string &getBody() const;
+	size_t getBodySize() const;
+	int getBodyFd() const;
+	void setBodyFile(int fd, size_t size);
 	std::string getHeader(const std::string &name) const;
 	const std::map<std::string, std::string> &getHeaders() const;
 
@@ -23,9 +27,11 @@ class HttpRequest
 	std::string uri_;
 	std::string http_version_;
 	std::map<std::string, std::string> headers_;
-	std::string body_;
+	mutable std::string body_;
 	bool is_valid_;
 	size_t body_length_;
+	int body_fd_;
+	size_t body_size_;
 	void clear();
 	bool parseRequestLine(const std::string &line);
 	bool parseHeaders(const std::string &headers);
@@ -1,20 +1,38 @@
 
 #pragma once
 
+#include <ctime>
 #include <string>
 #include <vector>
 
 class LocationConfig
 {
   public:
+	enum Method
+	{
+		METHOD_GET = 1,
+		METHOD_HEAD = 2,
+		METHOD_POST = 4,
+		METHOD_PUT = 8,
+		METHOD_DELETE = 16,
+		METHOD_OTHER = 32
+	};
 	LocationConfig();
 	~LocationConfig();
 	LocationConfig(const LocationConfig &other);
 	LocationConfig &operator=(const LocationConfig &other);
+	void buildCGIEnvironment(const std::string &server_name, int port);
+	void compile(const std::string &server_root);
+	bool allows(const std::string &method) const;
+	bool resolvePath(const std::string &uri, std::string &path) const;
+	static unsigned int methodBit(const std::string &method);
 	
 	std::string _path;
+	std::string _modifier;
 	std::string _root;
+	int _root_fd;
 	std::vector<std::string> _allowed_methods;
+	unsigned int _methods;
 	std::string _index_file;
 	bool _directory_listing;
 	std::string _cgi_path;
@@ -22,4 +40,22 @@ class LocationConfig
 	std::string _upload_path;
 	std::string _redirect;
 	size_t _client_max_body_size;
+	bool _gzip_static;
+	bool _gzip;
+	std::vector<std::string> _gzip_types;
+	size_t _gzip_min_length;
+	bool _metrics;
+	std::string _autoindex_format;
+	std::string _fastcgi_pass;
+	std::string _cgi_pool;
+	size_t _cgi_pool_idle;
+	size_t _cgi_pool_max;
+	size_t _cgi_pool_requests;
+	size_t _cgi_max_concurrency;
+	size_t _cgi_queue_size;
+	time_t _cgi_timeout;
+	bool _cgi_cache;
+	std::vector<std::string> _cgi_cache_key_headers;
+	std::string _cgi_env;
+	std::string _handler_module;
 };
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "LocationConfig.hpp"
+#include <map>
+#include <regex.h>
+#include <string>
+#include <vector>
+
+class LocationMatcher
+{
+  public:
+	LocationMatcher();
+	~LocationMatcher();
+	void compile(const std::vector<LocationConfig> &locations);
+	int find(const std::string &uri) const;
+
+  private:
+	struct Node
+	{
+		std::map<std::string, size_t> children;
+		int prefix;
+		int slash;
+	};
+	struct Pattern
+	{
+		regex_t *compiled;
+		int index;
+	};
+	std::vector<Node> _nodes;
+	std::map<std::string, int> _exact;
+	std::vector<Pattern> _patterns;
+	std::vector<bool> _skip_patterns;
+	void clear();
+	void insert(const std::string &path, int index);
+	LocationMatcher(const LocationMatcher &);
+	LocationMatcher &operator=(const LocationMatcher &);
+};
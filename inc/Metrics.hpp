@@ -0,0 +1,20 @@
+#pragma once
+
+#include <map>
+#include <sstream>
+#include <string>
+
+class Metrics
+{
+  public:
+	static void increment(const std::string &name, long delta = 1);
+	static void set(const std::string &name, long value);
+	static long get(const std::string &name);
+	static std::string render();
+	static std::string label(const std::string &name, const std::string &key,
+		const std::string &value);
+
+  private:
+	static std::map<std::string, long> _values;
+	Metrics();
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <ctime>
+#include <map>
+#include <set>
+#include <string>
+
+class NegativeCache
+{
+  public:
+	NegativeCache(size_t max_entries, time_t ttl);
+	~NegativeCache();
+	bool open();
+	int getFd() const;
+	bool contains(const std::string &path, time_t now);
+	void insert(const std::string &path, time_t now);
+	void handleEvents();
+	void clear();
+
+  private:
+	std::map<std::string, time_t> _entries;
+	std::map<std::string, int> _watches;
+	std::map<int, std::set<std::string> > _paths;
+	size_t _max_entries;
+	time_t _ttl;
+	int _fd;
+	int watch(const std::string &path);
+	void invalidate(int wd);
+	NegativeCache(const NegativeCache &);
+	NegativeCache &operator=(const NegativeCache &);
+};
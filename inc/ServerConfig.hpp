@@ -1,6 +1,8 @@
 #pragma once
 
 #include "LocationConfig.hpp"
+#include "LocationMatcher.hpp"
+#include <ctime>
 #include <map>
 #include <string>
 #include <vector>
@@ -16,9 +18,27 @@ class ServerConfig
 	void setPort(int port);
 	int _port;
 	std::string _host;
+	bool _default_server;
+	std::string _root;
 	std::vector<std::string> _server_names;
 	std::map<int, std::string> _error_pages;
 	size_t _client_max_body_size;
+	time_t _client_header_timeout;
+	time_t _client_body_timeout;
+	time_t _send_timeout;
+	size_t _recv_buffer_size;
+	size_t _client_header_buffer_size;
+	int _backlog;
+	bool _tcp_nodelay;
+	bool _tcp_nopush;
+	int _defer_accept;
+	int _fastopen;
+	int _rcvbuf;
+	int _sndbuf;
+	bool _ipv6only;
+	int _unix_mode;
 	std::vector<LocationConfig> _locations;
+	LocationMatcher _matcher;
+	void compileLocations();
 	const LocationConfig &findLocationForRequest(const std::string &uri_path) const;
 };
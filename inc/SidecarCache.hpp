@@ -0,0 +1,32 @@
+#pragma once
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+
+class SidecarCache
+{
+  public:
+	SidecarCache();
+	~SidecarCache();
+	std::string select(const std::string &path, const struct stat &info,
+		const std::string &accept_encoding, std::string &encoding);
+	void clear();
+
+  private:
+	struct Entry
+	{
+		time_t checked;
+		time_t mtime;
+		off_t size;
+		bool has_br;
+		bool has_gz;
+	};
+	static const size_t MAX_ENTRIES = 4096;
+	static const time_t RECHECK_SECONDS = 5;
+	std::map<std::string, Entry> _entries;
+	static bool isFresh(const std::string &sidecar, time_t source_mtime);
+	SidecarCache(const SidecarCache &);
+	SidecarCache &operator=(const SidecarCache &);
+};
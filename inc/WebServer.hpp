@@ -2,8 +2,18 @@
 #ifndef WEBSERVER_HPP
 #define WEBSERVER_HPP
 
+#include "BodyStream.hpp"
+#include "CGICache.hpp"
+#include "CompressionCache.hpp"
+#include "DirectoryListing.hpp"
+#include "FastCGI.hpp"
+#include "HandlerModule.hpp"
+#include "HttpRequest.hpp"
+#include "NegativeCache.hpp"
 #include "ServerConfig.hpp"
+#include "SidecarCache.hpp"
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
 #include <string>
 #include <vector>
@@ -12,16 +22,36 @@
 #include <cerrno>
 #include <cstdio>
 #include <cstring>
+#include <deque>
 #include <dirent.h>
 #include <fcntl.h>
 #include <iostream>
 #include <map>
 #include <sstream>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <sys/time.h>
 
+class CGI;
+
+struct VirtualHosts
+{
+	std::map<std::string, const ServerConfig *> names;
+	std::map<std::string, const ServerConfig *> wildcards;
+	const ServerConfig *default_server;
+	bool tcp_nopush;
+};
+
+struct Generation
+{
+	std::vector<ServerConfig> servers;
+	std::map<int, VirtualHosts> virtual_hosts;
+	std::map<std::string, int> root_fds;
+	size_t connections;
+};
+
 struct ClientConnection
 {
 	int fd;
@@ -29,8 +59,38 @@ struct ClientConnection
 	time_t last_activity;
 	bool keep_alive;
 	const ServerConfig *server;
+	const VirtualHosts *vhosts;
+	Generation *generation;
 	std::string client_ip;
 	bool needs_cookie;
+	std::string out;
+	size_t out_offset;
+	BodySource *source;
+	std::vector<BodyEncoder *> encoders;
+	bool close_after_write;
+	CGI *cgi;
+	StreamSource *cgi_stream;
+	bool cgi_paused;
+	int spool_fd;
+	size_t spool_size;
+	size_t spool_remaining;
+	std::string pipelined;
+	std::string cache_key;
+	bool cgi_queued;
+};
+
+struct PendingCGI
+{
+	HttpRequest request;
+	const LocationConfig *location;
+	std::string script_path;
+	long queued_at;
+};
+
+struct PrebuiltResponse
+{
+	std::string response;
+	std::string metric;
 };
 
 class HttpRequest;
@@ -41,15 +101,36 @@ struct ClientConnection;
 class WebServer
 {
 public:
-	WebServer(const std::vector<ServerConfig> &servers);
+	WebServer(const std::vector<ServerConfig> &servers, const std::string &config_file,
+			  const std::string &executable);
 	~WebServer();
 	void run();
 
 private:
-	void setupSockets();
+	std::map<std::string, int> setupSockets(Generation &generation);
+	int openListener(const ServerConfig &server);
+	void applyListenOptions(int server_fd, const ServerConfig &server);
+	void closeListeners(const std::map<std::string, int> &active);
+	void addVirtualHost(VirtualHosts &vhosts, const ServerConfig &server);
+	void prepareLocations(Generation &generation);
+	void reload();
+	void shutdown();
+	void drain();
+	void upgrade();
+	void inheritListeners();
+	void retireGeneration(Generation *generation);
+	void destroyGeneration(Generation *generation);
+	void eraseClient(std::map<int, ClientConnection>::iterator it);
 	void mainLoop();
 	void acceptNewConnection(int server_fd);
 	void handleClientData(int client_fd);
+	void handleClientWrite(int client_fd);
+	void pumpBody(ClientConnection &conn);
+	void updatePollEvents(int fd, short events);
+	void processBuffer(ClientConnection &conn);
+	bool spoolBody(ClientConnection &conn);
+	void writeSpool(ClientConnection &conn, const char *data, size_t len);
+	void closeSpool(ClientConnection &conn);
 	void removeClient(int client_fd);
 	void checkTimeouts();
 	bool isCompleteRequest(const std::string &buffer);
@@ -62,21 +143,84 @@ private:
 						  const LocationConfig &location);
 	void handleDeleteRequest(ClientConnection &conn, const HttpRequest &request,
 							 const LocationConfig &location);
+	void handleModuleRequest(ClientConnection &conn, const HttpRequest &request,
+							 const LocationConfig &location);
 	void handleCGIRequest(ClientConnection &conn, const HttpRequest &request,
 						  const LocationConfig &location, const std::string &script_path);
+	void runCGI(ClientConnection &conn, const HttpRequest &request,
+				const LocationConfig &location, const std::string &script_path);
+	bool acquireCGISlot(ClientConnection &conn, const HttpRequest &request,
+						const LocationConfig &location, const std::string &script_path);
+	void releaseCGISlot(const LocationConfig &location);
+	void launchCGI(ClientConnection &conn, const HttpRequest &request,
+				   const LocationConfig &location, const std::string &script_path);
+	bool serveCachedCGI(ClientConnection &conn, const HttpRequest &request,
+						const LocationConfig &location, const std::string &script_path);
+	void revalidateCGI(const ClientConnection &origin, const std::string &key,
+					   const HttpRequest &request, const LocationConfig &location,
+					   const std::string &script_path);
+	void releaseCacheLock(ClientConnection &conn);
+	void deferCGI(ClientConnection &conn, const HttpRequest &request,
+				  const LocationConfig &location, const std::string &script_path);
+	void dropPendingCGI(std::map<int, PendingCGI>::iterator pending);
+	void resumePendingCGI();
+	void deliverCGIResponse(ClientConnection &conn, std::string response,
+							const HttpRequest &request, const LocationConfig &location);
+	void handleCGIEvent(int pipe_fd);
+	void reapChildren();
+	void syncFastCGI();
+	void streamCGI(ClientConnection &conn);
+	void throttleCGI(ClientConnection &conn);
+	void finishCGI(ClientConnection &conn);
+	void unwatchCGI(CGI *cgi);
+	void removePollFd(int fd);
 	void handleFileUpload(ClientConnection &conn, const HttpRequest &request,
 						  const LocationConfig &location);
-	void serveStaticFile(int client_fd, const std::string &file_path,
-						 bool head_only = false);
+	void serveStaticFile(ClientConnection &conn, int fd, const struct stat &info,
+						 const std::string &file_path, const HttpRequest &request,
+						 const LocationConfig &location);
+	bool isCompressible(const HttpRequest &request, const LocationConfig &location,
+						const std::string &content_type, long length) const;
+	void queueStream(ClientConnection &conn, std::string head, BodySource *body,
+					 const std::string &encoding, bool chunked, BodyEncoder *cache_fill = NULL);
+	void addSessionCookie(ClientConnection &conn, std::string &head);
 	void sendResponse(int client_fd, const HttpResponse &response);
+	void queueData(int client_fd, const std::string &data);
+	void loadErrorPages(const Generation &generation);
 	void sendErrorResponse(int client_fd, int code, const std::string &message,
 						   const ServerConfig *server = NULL);
 	void sendRedirectResponse(int client_fd, int code,
 							  const std::string &location);
-	static std::string toString(int num);
-	std::vector<ServerConfig> _servers;
+	static std::string toString(long num);
+	std::string _config_file;
+	std::string _executable;
+	bool _draining;
+	time_t _drain_deadline;
+	std::map<std::string, int> _inherited;
+	pid_t _successor;
+	Generation *_generation;
+	std::vector<Generation *> _retired;
 	std::vector<struct pollfd> _poll_fds;
+	std::vector<char> _recv_buffer;
 	std::vector<int> _server_fds;
+	std::map<std::string, int> _listeners;
+	std::map<int, int> _cgi_fds;
+	std::map<pid_t, int> _cgi_pids;
+	std::map<int, short> _fastcgi_fds;
+	FastCGIClient _fastcgi;
+	CGICache _cgi_cache;
+	std::map<std::string, HandlerModule *> _modules;
+	std::map<int, PendingCGI> _pending_cgi;
+	std::vector<int> _cgi_retry;
+	std::map<const LocationConfig *, size_t> _cgi_running;
+	std::map<const LocationConfig *, std::deque<int> > _cgi_queues;
+	int _next_detached_fd;
+	SidecarCache _sidecars;
+	CompressionCache _compressed;
+	DirectoryCache _directories;
+	NegativeCache _missing;
+	std::map<std::pair<const ServerConfig *, int>, PrebuiltResponse> _error_pages;
+	std::map<std::pair<int, std::string>, PrebuiltResponse> _fallback_errors;
 	static std::string generateSessionId();
 };
 
@@ -13,6 +13,8 @@
 #include <ctime>
 #include <unistd.h>
 #include <iomanip>
+#include <cstdlib>
+#include <cstdio>
 
 bool	isDirectory(const std::string &path);
 bool	isFile(const std::string &path);
@@ -21,10 +23,10 @@ bool	isReadable(const std::string &path);
 bool	isWritable(const std::string &path);
 bool	isExecutable(const std::string &path);
 size_t	getFileSize(const std::string &path);
+int		openBeneath(int dir_fd, const char *path, int flags);
+std::string absolutePath(const std::string &path);
 std::string readFile(const std::string &path);
 bool	writeFile(const std::string &path, const std::string &content);
-std::string generateDirectoryListing(const std::string &path,
-	const std::string &uri);
 std::string formatFileSize(size_t size);
 std::string formatTime(time_t timestamp);
 std::string getMimeType(const std::string &path);
@@ -36,3 +38,6 @@ std::string toUpperCase(const std::string &str);
 std::vector<std::string> split(const std::string &str, char delimiter);
 std::string join(const std::vector<std::string> &strings,
 	const std::string &delimiter);
+std::string htmlEscape(const std::string &str);
+std::string jsonEscape(const std::string &str);
+bool	acceptsEncoding(const std::string &header, const std::string &coding);
@@ -0,0 +1,64 @@
+#ifndef WEBSERV_MODULE_H
+#define WEBSERV_MODULE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define WEBSERV_MODULE_ABI_VERSION 2
+#define WEBSERV_MODULE_SYMBOL "webserv_module_entry"
+
+struct webserv_header
+{
+	const char *name;
+	const char *value;
+};
+
+/* Valid only for the duration of the handle() call. Small bodies are passed
+   in memory through body; a body spooled to disk leaves body NULL and must
+   be read from body_fd with pread(), which is -1 otherwise. */
+struct webserv_request
+{
+	const char *method;
+	const char *uri;
+	const char *path;
+	const char *query;
+	const char *protocol;
+	const char *remote_addr;
+	const struct webserv_header *headers;
+	size_t header_count;
+	const char *body;
+	size_t body_length;
+	int body_fd;
+};
+
+/* write() appends to the connection's output queue. handle() runs inside the
+   event loop, so everything it writes stays queued in memory until it returns. */
+struct webserv_response
+{
+	void *context;
+	void (*set_status)(struct webserv_response *response, int status);
+	void (*add_header)(struct webserv_response *response, const char *name,
+		const char *value);
+	void (*write)(struct webserv_response *response, const void *data, size_t length);
+};
+
+/* Exported by every module as WEBSERV_MODULE_SYMBOL. init and cleanup may be NULL.
+   handle returns 0 on success; anything else is answered with 500. */
+struct webserv_module
+{
+	int abi_version;
+	const char *name;
+	int (*init)(void);
+	void (*cleanup)(void);
+	int (*handle)(const struct webserv_request *request, struct webserv_response *response);
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,46 @@
+#include "webserv_module.h"
+#include <string.h>
+
+static const char page[] =
+	"<!DOCTYPE html>\n"
+	"<html>\n"
+	"<head>\n"
+	"    <title>Hello Module</title>\n"
+	"    <style>\n"
+	"        body { font-family: Arial, sans-serif; margin: 40px; text-align: center; }\n"
+	"        h1 { color: #4CAF50; }\n"
+	"        .info { background: #f0f0f0; padding: 20px; border-radius: 5px; margin: 20px auto; max-width: 500px; }\n"
+	"    </style>\n"
+	"</head>\n"
+	"<body>\n"
+	"    <h1>Hello from a native module!</h1>\n"
+	"    <div class=\"info\">\n"
+	"        <p><strong>Module:</strong> hello.so</p>\n"
+	"        <p><strong>Server:</strong> webserv/1.0</p>\n"
+	"        <p><strong>Method:</strong> ";
+
+static const char tail[] =
+	"</p>\n"
+	"        <p>This proves that native handlers are working correctly!</p>\n"
+	"    </div>\n"
+	"    <p><a href=\"/\"> Back to main page</a></p>\n"
+	"</body>\n"
+	"</html>\n";
+
+static int handle(const struct webserv_request *request, struct webserv_response *response)
+{
+	response->set_status(response, 200);
+	response->add_header(response, "content-type", "text/html");
+	response->write(response, page, sizeof(page) - 1);
+	response->write(response, request->method, strlen(request->method));
+	response->write(response, tail, sizeof(tail) - 1);
+	return 0;
+}
+
+const struct webserv_module webserv_module_entry = {
+	WEBSERV_MODULE_ABI_VERSION,
+	"hello",
+	NULL,
+	NULL,
+	handle
+};
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+# Long-lived CGI worker for cgi_pool locations. webserv hands it a
+# connected socket as stdin and sends FastCGI records over it; each
+# request runs the script in-process with a fresh environment.
+#
+# Given an address (unix:/path or host:port) it instead listens there as
+# a standalone FastCGI responder for fastcgi_pass locations, forking one
+# process per accepted connection.
+
+import io
+import os
+import signal
+import socket
+import struct
+import sys
+import traceback
+
+FCGI_BEGIN_REQUEST = 1
+FCGI_END_REQUEST = 3
+FCGI_PARAMS = 4
+FCGI_STDIN = 5
+FCGI_STDOUT = 6
+FCGI_STDERR = 7
+RECORD_CHUNK = 65528
+
+compiled = {}
+
+
+def read_exact(conn, size):
+    data = b""
+    while len(data) < size:
+        chunk = conn.recv(size - len(data))
+        if not chunk:
+            return None
+        data += chunk
+    return data
+
+
+def read_record(conn):
+    header = read_exact(conn, 8)
+    if header is None:
+        return None
+    _, kind, request_id, length, padding, _ = struct.unpack(">BBHHBB", header)
+    content = read_exact(conn, length + padding)
+    if content is None:
+        return None
+    return kind, request_id, content[:length]
+
+
+def send_record(conn, kind, request_id, data):
+    offset = 0
+    while True:
+        chunk = data[offset:offset + RECORD_CHUNK]
+        padding = (8 - len(chunk) % 8) % 8
+        conn.sendall(struct.pack(">BBHHBB", 1, kind, request_id, len(chunk), padding, 0)
+                     + chunk + b"\0" * padding)
+        offset += RECORD_CHUNK
+        if not chunk or offset >= len(data):
+            break
+
+
+def parse_pairs(data):
+    pairs = {}
+    pos = 0
+    while pos < len(data):
+        lengths = []
+        for _ in range(2):
+            if data[pos] < 128:
+                lengths.append(data[pos])
+                pos += 1
+            else:
+                lengths.append(struct.unpack(">I", data[pos:pos + 4])[0] & 0x7fffffff)
+                pos += 4
+        name = data[pos:pos + lengths[0]].decode("latin-1")
+        value = data[pos + lengths[0]:pos + lengths[0] + lengths[1]].decode("latin-1")
+        pairs[name] = value
+        pos += lengths[0] + lengths[1]
+    return pairs
+
+
+def load(script):
+    mtime = os.stat(script).st_mtime_ns
+    cached = compiled.get(script)
+    if cached is None or cached[0] != mtime:
+        with open(script, "rb") as source:
+            cached = (mtime, compile(source.read(), script, "exec"))
+        compiled[script] = cached
+    return cached[1]
+
+
+def run(env, body):
+    script = env.get("SCRIPT_FILENAME", "")
+    saved = (dict(os.environ), os.getcwd(), sys.argv, sys.stdin, sys.stdout, sys.path[0])
+    output = io.BytesIO()
+    status = 0
+    os.environ.clear()
+    os.environ.update(env)
+    sys.argv = [script]
+    sys.stdin = io.TextIOWrapper(io.BytesIO(body), encoding="utf-8")
+    sys.stdout = io.TextIOWrapper(output, encoding="utf-8", write_through=True)
+    sys.path[0] = os.path.dirname(script)
+    try:
+        os.chdir(os.path.dirname(script))
+        exec(load(script), {"__name__": "__main__", "__file__": script})
+    except SystemExit as exit:
+        status = exit.code if isinstance(exit.code, int) else (exit.code is not None)
+    except Exception:
+        traceback.print_exc()
+        status = 1
+    finally:
+        sys.stdout.flush()
+        sys.stdout.detach()
+        os.environ.clear()
+        os.environ.update(saved[0])
+        os.chdir(saved[1])
+        sys.argv, sys.stdin, sys.stdout, sys.path[0] = saved[2:]
+    return output.getvalue(), status
+
+
+def serve(conn):
+    requests = {}
+    while True:
+        record = read_record(conn)
+        if record is None:
+            return
+        kind, request_id, content = record
+        if kind == FCGI_BEGIN_REQUEST:
+            requests[request_id] = [b"", b""]
+        elif kind == FCGI_PARAMS and request_id in requests:
+            requests[request_id][0] += content
+        elif kind == FCGI_STDIN and request_id in requests:
+            if content:
+                requests[request_id][1] += content
+                continue
+            params, body = requests.pop(request_id)
+            output, status = run(parse_pairs(params), body)
+            send_record(conn, FCGI_STDOUT, request_id, output)
+            if output:
+                send_record(conn, FCGI_STDOUT, request_id, b"")
+            send_record(conn, FCGI_END_REQUEST, request_id,
+                         struct.pack(">IB3x", status & 0xff, 0))
+
+
+def listen(address):
+    if address.startswith("unix:"):
+        path = address[5:]
+        if os.path.exists(path):
+            os.unlink(path)
+        server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        server.bind(path)
+    else:
+        host, _, port = address.rpartition(":")
+        server = socket.socket(socket.AF_INET6 if ":" in host else socket.AF_INET,
+                               socket.SOCK_STREAM)
+        server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        server.bind((host.strip("[]") or "127.0.0.1", int(port or 9000)))
+    server.listen(64)
+    signal.signal(signal.SIGCHLD, signal.SIG_IGN)
+    while True:
+        conn, _ = server.accept()
+        if os.fork() == 0:
+            server.close()
+            try:
+                serve(conn)
+            finally:
+                os._exit(0)
+        conn.close()
+
+
+def main():
+    if len(sys.argv) > 1:
+        listen(sys.argv[1])
+    else:
+        serve(socket.socket(fileno=os.dup(0)))
+
+
+if __name__ == "__main__":
+    main()
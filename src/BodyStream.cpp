@@ -0,0 +1,115 @@
+#include "../inc/BodyStream.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+
+StringSource::StringSource(const std::string &data) : _data(data), _offset(0)
+{
+}
+
+bool StringSource::produce(std::string &out, size_t max)
+{
+    size_t n = std::min(max, _data.size() - _offset);
+
+    out.append(_data, _offset, n);
+    _offset += n;
+    return _offset < _data.size();
+}
+
+StreamSource::StreamSource() : _closed(false)
+{
+}
+
+void StreamSource::append(const std::string &data)
+{
+    _data += data;
+}
+
+void StreamSource::close()
+{
+    _closed = true;
+}
+
+size_t StreamSource::buffered() const
+{
+    return _data.size();
+}
+
+bool StreamSource::produce(std::string &out, size_t max)
+{
+    size_t n = std::min(max, _data.size());
+
+    out.append(_data, 0, n);
+    _data.erase(0, n);
+    return !_closed || !_data.empty();
+}
+
+FileSource::FileSource(int fd, off_t length) : _fd(fd), _remaining(length)
+{
+}
+
+FileSource::~FileSource()
+{
+    if (_fd >= 0)
+    {
+        close(_fd);
+    }
+}
+
+bool FileSource::produce(std::string &out, size_t max)
+{
+    char buffer[65536];
+    size_t want = std::min(max, sizeof(buffer));
+    ssize_t bytes;
+
+    if (_remaining <= 0)
+    {
+        return false;
+    }
+    if (static_cast<off_t>(want) > _remaining)
+    {
+        want = static_cast<size_t>(_remaining);
+    }
+    bytes = read(_fd, buffer, want);
+    if (bytes <= 0)
+    {
+        _remaining = 0;
+        return false;
+    }
+    out.append(buffer, bytes);
+    _remaining -= bytes;
+    return _remaining > 0;
+}
+
+void ChunkedEncoder::encode(const char *data, size_t len, std::string &out)
+{
+    char size_line[32];
+
+    if (len == 0)
+    {
+        return;
+    }
+    snprintf(size_line, sizeof(size_line), "%lx\r\n", static_cast<unsigned long>(len));
+    out += size_line;
+    out.append(data, len);
+    out += "\r\n";
+}
+
+void ChunkedEncoder::finish(std::string &out)
+{
+    out += "0\r\n\r\n";
+}
+
+DeflateEncoder::DeflateEncoder(Deflater::Format format) : _deflater(format)
+{
+}
+
+void DeflateEncoder::encode(const char *data, size_t len, std::string &out)
+{
+    _deflater.compress(data, len, out);
+}
+
+void DeflateEncoder::finish(std::string &out)
+{
+    _deflater.finish(out);
+}
@@ -3,280 +3,433 @@
 #include "../inc/HttpRequest.hpp"
 #include "../inc/LocationConfig.hpp"
 
-CGI::CGI(const HttpRequest &request,
-         const LocationConfig &location) : request_(request), location_(location),
-                                           env_vars_(), timeout_seconds_(30)
+CGI::CGI(const HttpRequest &request, const LocationConfig &location,
+         const std::string &remote_addr) : request_(request), location_(location), env_(),
+                                           envp_(), timeout_seconds_(location._cgi_timeout), activity_time_(0),
+                                           pid_(-1), input_fd_(-1), output_fd_(-1),
+                                           input_offset_(0), body_fd_(-1), input_buffer_(),
+                                           output_(), head_parsed_(false),
+                                           head_(), head_has_length_(false), exited_(false),
+                                           exit_status_(0), error_code_(0)
 {
-    setupEnvironment();
+    if (request.getBodyFd() >= 0)
+    {
+        body_fd_ = fcntl(request.getBodyFd(), F_DUPFD_CLOEXEC, 0);
+        request_.setBodyFile(body_fd_, request.getBodySize());
+    }
+    setupEnvironment(remote_addr);
 }
 
 CGI::~CGI()
 {
-    for (size_t i = 0; i < env_vars_.size(); ++i)
+    closeInput();
+    closeOutput();
+    if (body_fd_ >= 0)
+    {
+        close(body_fd_);
+    }
+    if (pid_ > 0 && !exited_)
     {
-        delete[] env_vars_[i];
+        kill(pid_, SIGKILL);
     }
 }
 
-std::string CGI::execute(const std::string &script_path)
+bool CGI::start(const std::string &script_path)
 {
     int pipe_in[2];
     int pipe_out[2];
-    pid_t pid;
+    posix_spawn_file_actions_t actions;
+    const char *argv[3];
+    int error;
 
-    if (pipe(pipe_in) == -1 || pipe(pipe_out) == -1)
+    std::string directory = getDirectoryPath(script_path);
+    std::string script_name = script_path.substr(script_path.find_last_of('/') + 1);
+    if (pipe2(pipe_in, O_CLOEXEC) == -1)
     {
-        return (generateErrorResponse(500, "Failed to create pipes"));
+        return (false);
     }
-    pid = fork();
-    if (pid == -1)
+    if (pipe2(pipe_out, O_CLOEXEC) == -1)
     {
         close(pipe_in[0]);
         close(pipe_in[1]);
-        close(pipe_out[0]);
-        close(pipe_out[1]);
-        return (generateErrorResponse(500, "Failed to fork process"));
+        return (false);
     }
-    if (pid == 0)
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipe_in[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, pipe_out[1], STDOUT_FILENO);
+    if (!directory.empty())
     {
-        executeCGIChild(script_path, pipe_in, pipe_out);
-        exit(1);
+        posix_spawn_file_actions_addchdir_np(&actions, directory.c_str());
     }
-    else
+    argv[0] = location_._cgi_path.c_str();
+    argv[1] = script_name.c_str();
+    argv[2] = NULL;
+    std::cerr << "CGI: Executing: " << argv[0] << " " << argv[1] << std::endl;
+    std::cerr << "CGI: Working directory: " << directory << std::endl;
+    error = posix_spawn(&pid_, argv[0], &actions, NULL, const_cast<char **>(argv),
+                        &envp_[0]);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipe_in[0]);
+    close(pipe_out[1]);
+    if (error != 0)
+    {
+        std::cerr << "CGI execution failed: " << strerror(error) << std::endl;
+        close(pipe_in[1]);
+        close(pipe_out[0]);
+        pid_ = -1;
+        return (false);
+    }
+    input_fd_ = pipe_in[1];
+    output_fd_ = pipe_out[0];
+    fcntl(input_fd_, F_SETFL, O_NONBLOCK);
+    fcntl(output_fd_, F_SETFL, O_NONBLOCK);
+    activity_time_ = time(NULL);
+    if (request_.getMethod() != "POST" || request_.getBodySize() == 0)
     {
-        return (handleCGIParent(pid, pipe_in, pipe_out));
+        closeInput();
     }
+    return (true);
 }
 
-void CGI::setupEnvironment()
+bool CGI::writeInput()
 {
-    size_t query_pos;
+    ssize_t bytes;
+
+    while (input_fd_ >= 0)
+    {
+        if (input_buffer_.empty() && !fillInput())
+        {
+            break;
+        }
+        bytes = write(input_fd_, input_buffer_.data(), input_buffer_.size());
+        if (bytes < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return (true);
+            }
+            break;
+        }
+        input_buffer_.erase(0, bytes);
+        activity_time_ = time(NULL);
+    }
+    closeInput();
+    return (false);
+}
 
-    env_map_.clear();
-    env_map_["REQUEST_METHOD"] = request_.getMethod();
-    env_map_["SERVER_PROTOCOL"] = request_.getHttpVersion();
-    env_map_["GATEWAY_INTERFACE"] = "CGI/1.1";
-    env_map_["SERVER_SOFTWARE"] = "webserv/1.0";
-    env_map_["SERVER_NAME"] = "localhost";
-    env_map_["SERVER_PORT"] = "8080";
+bool CGI::fillInput()
+{
+    char buffer[65536];
+    size_t size = request_.getBodySize();
+    ssize_t bytes;
 
-    std::string uri = request_.getUri();
-    query_pos = uri.find('?');
-    if (query_pos != std::string::npos)
+    if (input_offset_ >= size)
     {
-        env_map_["PATH_INFO"] = uri.substr(0, query_pos);
-        env_map_["QUERY_STRING"] = uri.substr(query_pos + 1);
+        return (false);
     }
-    else
+    if (body_fd_ >= 0)
     {
-        env_map_["PATH_INFO"] = uri;
-        env_map_["QUERY_STRING"] = "";
+        bytes = pread(body_fd_, buffer, std::min(sizeof(buffer), size - input_offset_),
+                      input_offset_);
+        if (bytes <= 0)
+        {
+            return (false);
+        }
+        input_buffer_.assign(buffer, bytes);
     }
-
-    env_map_["SCRIPT_NAME"] = env_map_["PATH_INFO"];
-
-    env_map_["REQUEST_URI"] = uri;
-
-    const std::map<std::string, std::string> &headers = request_.getHeaders();
-    for (std::map<std::string, std::string>::const_iterator it = headers.begin();
-         it != headers.end(); ++it)
+    else
     {
-        std::string env_name = "HTTP_" + toUpperSnakeCase(it->first);
-        env_map_[env_name] = it->second;
+        input_buffer_ = request_.getBody().substr(input_offset_, sizeof(buffer));
+        bytes = input_buffer_.size();
     }
+    input_offset_ += bytes;
+    return (true);
+}
 
-    if (request_.getMethod() == "POST")
+bool CGI::readOutput(size_t limit)
+{
+    char buffer[65536];
+    ssize_t bytes;
+
+    while (output_fd_ >= 0)
     {
-        std::string content_type = request_.getHeader("content-type");
-        std::string content_length = request_.getHeader("content-length");
-        if (!content_type.empty())
+        if (output_.size() >= limit)
         {
-            env_map_["CONTENT_TYPE"] = content_type;
+            return (true);
         }
-        if (!content_length.empty())
+        bytes = read(output_fd_, buffer, sizeof(buffer));
+        if (bytes > 0)
+        {
+            output_.append(buffer, bytes);
+            activity_time_ = time(NULL);
+            continue;
+        }
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
         {
-            env_map_["CONTENT_LENGTH"] = content_length;
+            return (true);
         }
+        closeOutput();
     }
+    return (false);
+}
 
-    env_map_["REMOTE_ADDR"] = "127.0.0.1";
-    env_map_["REMOTE_HOST"] = "localhost";
-
-    char *path_env = getenv("PATH");
-    if (path_env)
+void CGI::closeInput()
+{
+    if (input_fd_ >= 0)
     {
-        env_map_["PATH"] = path_env;
+        close(input_fd_);
+        input_fd_ = -1;
     }
-    else
-    {
+}
 
-        env_map_["PATH"] = "/usr/local/bin:/usr/bin:/bin";
+void CGI::closeOutput()
+{
+    if (output_fd_ >= 0)
+    {
+        close(output_fd_);
+        output_fd_ = -1;
     }
+}
+
+void CGI::startRemote(const std::string &script_path)
+{
+    char resolved[PATH_MAX];
 
+    addVariable("SCRIPT_FILENAME", realpath(script_path.c_str(), resolved) ? resolved : script_path);
     buildEnvArray();
+    activity_time_ = time(NULL);
 }
 
-void CGI::buildEnvArray()
+void CGI::appendOutput(const char *data, size_t len)
 {
-    char *env_var;
+    output_.append(data, len);
+    activity_time_ = time(NULL);
+}
 
-    for (size_t i = 0; i < env_vars_.size(); ++i)
+void CGI::fail(int code, const std::string &message)
+{
+    if (error_code_ == 0)
     {
-        delete[] env_vars_[i];
+        error_code_ = code;
+        error_message_ = message;
     }
-    env_vars_.clear();
-    for (std::map<std::string,
-                  std::string>::const_iterator it = env_map_.begin();
-         it != env_map_.end(); ++it)
+}
+
+void CGI::setExitStatus(int status)
+{
+    exited_ = true;
+    exit_status_ = status;
+}
+
+void CGI::terminate()
+{
+    fail(504, "CGI timeout");
+    closeInput();
+    closeOutput();
+    if (pid_ > 0 && !exited_)
     {
-        std::string env_str = it->first + "=" + it->second;
-        env_var = new char[env_str.length() + 1];
-        std::strcpy(env_var, env_str.c_str());
-        env_vars_.push_back(env_var);
+        kill(pid_, SIGTERM);
     }
-    env_vars_.push_back(NULL);
 }
 
-void CGI::executeCGIChild(const std::string &script_path, int pipe_in[2],
-                          int pipe_out[2])
+bool CGI::isComplete() const
 {
-    const char *argv[3];
-    size_t last_slash;
+    return (error_code_ != 0 || (exited_ && output_fd_ < 0));
+}
 
-    close(pipe_in[1]);
-    dup2(pipe_in[0], STDIN_FILENO);
-    close(pipe_in[0]);
-    close(pipe_out[0]);
-    dup2(pipe_out[1], STDOUT_FILENO);
-    close(pipe_out[1]);
+bool CGI::hasTimedOut(time_t now) const
+{
+    return (now - activity_time_ > timeout_seconds_);
+}
 
-    std::string directory = getDirectoryPath(script_path);
-    if (!directory.empty())
+std::string CGI::getResponse()
+{
+    if (error_code_ != 0)
     {
-        if (chdir(directory.c_str()) != 0)
-        {
-            std::cerr << "CGI: Failed to change directory to: " << directory << std::endl;
-            exit(1);
-        }
+        return (generateErrorResponse(error_code_, error_message_));
     }
-
-    std::string script_name = script_path;
-    last_slash = script_path.find_last_of('/');
-    if (last_slash != std::string::npos)
+    if (WIFEXITED(exit_status_) && WEXITSTATUS(exit_status_) != 0)
     {
-        script_name = script_path.substr(last_slash + 1);
+        std::cerr << "CGI exited with code: " << WEXITSTATUS(exit_status_) << std::endl;
+        return (generateErrorResponse(500, "CGI script error"));
     }
-    argv[0] = location_._cgi_path.c_str();
-    argv[1] = script_name.c_str();
-    argv[2] = NULL;
+    return (parseCGIOutput(output_));
+}
 
-    std::cerr << "CGI: Executing: " << argv[0] << " " << argv[1] << std::endl;
-    std::cerr << "CGI: Working directory: " << directory << std::endl;
-    execve(argv[0], const_cast<char **>(argv), &env_vars_[0]);
+const std::string &CGI::getHead() const
+{
+    return (head_);
+}
 
-    std::cerr << "CGI execution failed: " << strerror(errno) << std::endl;
-    std::cerr << "CGI path: " << argv[0] << std::endl;
-    std::cerr << "Script: " << argv[1] << std::endl;
-    exit(1);
+bool CGI::hasContentLength() const
+{
+    return (head_has_length_);
 }
 
-std::string CGI::handleCGIParent(pid_t pid, int pipe_in[2], int pipe_out[2])
+std::string CGI::takeOutput()
 {
-    int flags;
-    char buffer[4096];
-    time_t start_time;
-    int status;
-    pid_t result;
-    ssize_t bytes;
+    std::string data;
 
-    close(pipe_in[0]);
-    close(pipe_out[1]);
-    if (request_.getMethod() == "POST" && !request_.getBody().empty())
+    data.swap(output_);
+    return (data);
+}
+
+size_t CGI::getOutputSize() const
+{
+    return (output_.size());
+}
+
+bool CGI::hasFailed() const
+{
+    return (error_code_ != 0 || (WIFEXITED(exit_status_) && WEXITSTATUS(exit_status_) != 0));
+}
+
+int CGI::getInputFd() const
+{
+    return (input_fd_);
+}
+
+int CGI::getOutputFd() const
+{
+    return (output_fd_);
+}
+
+pid_t CGI::getPid() const
+{
+    return (pid_);
+}
+
+const HttpRequest &CGI::getRequest() const
+{
+    return (request_);
+}
+
+char *const *CGI::getEnvironment() const
+{
+    return (&envp_[0]);
+}
+
+const LocationConfig &CGI::getLocation() const
+{
+    return (location_);
+}
+
+void CGI::setupEnvironment(const std::string &remote_addr)
+{
+    const std::string &uri = request_.getUri();
+    size_t query_pos = uri.find('?');
+    const std::map<std::string, std::string> &headers = request_.getHeaders();
+    size_t size = location_._cgi_env.size() + uri.size() * 3 + remote_addr.size() * 2 + 256;
+
+    for (std::map<std::string, std::string>::const_iterator it = headers.begin();
+         it != headers.end(); ++it)
     {
-        write(pipe_in[1], request_.getBody().c_str(),
-              request_.getBody().length());
+        size += it->first.size() + it->second.size() + 7;
     }
-    close(pipe_in[1]);
-    flags = fcntl(pipe_out[0], F_GETFL, 0);
-    fcntl(pipe_out[0], F_SETFL, flags | O_NONBLOCK);
-    std::string output;
-    start_time = time(NULL);
-    while (true)
+    env_.reserve(size);
+    env_ = location_._cgi_env;
+    addVariable("REQUEST_METHOD", request_.getMethod());
+    addVariable("SERVER_PROTOCOL", request_.getHttpVersion());
+    addVariable("PATH_INFO", uri.substr(0, query_pos));
+    addVariable("SCRIPT_NAME", uri.substr(0, query_pos));
+    addVariable("QUERY_STRING", query_pos == std::string::npos ? "" : uri.substr(query_pos + 1));
+    addVariable("REQUEST_URI", uri);
+    for (std::map<std::string, std::string>::const_iterator it = headers.begin();
+         it != headers.end(); ++it)
     {
-        if (time(NULL) - start_time > timeout_seconds_)
+        env_ += "HTTP_";
+        for (size_t i = 0; i < it->first.size(); ++i)
         {
-            kill(pid, SIGTERM);
-            waitpid(pid, &status, 0);
-            if (WIFEXITED(status))
-            {
-                int exit_code = WEXITSTATUS(status);
-                std::cerr << "CGI exited with code: " << exit_code << std::endl;
-                if (exit_code != 0)
-                {
-                    std::cerr << "CGI output: " << output << std::endl;
-                    return generateErrorResponse(500, "CGI script error (exit code: " + toString(exit_code) + ")");
-                }
-            }
-            close(pipe_out[0]);
-            return (generateErrorResponse(504, "CGI timeout"));
+            env_ += (it->first[i] == '-') ? '_' : static_cast<char>(std::toupper(it->first[i]));
         }
-        result = waitpid(pid, &status, WNOHANG);
-        if (result == pid)
-        {
-            while ((bytes = read(pipe_out[0], buffer, sizeof(buffer))) > 0)
-            {
-                output.append(buffer, bytes);
-            }
-            break;
-        }
-        bytes = read(pipe_out[0], buffer, sizeof(buffer));
-        if (bytes > 0)
+        env_ += '=';
+        env_ += it->second;
+        env_ += '\0';
+    }
+    if (request_.getMethod() == "POST")
+    {
+        std::string content_type = request_.getHeader("content-type");
+        std::string content_length = request_.getHeader("content-length");
+        if (!content_type.empty())
         {
-            output.append(buffer, bytes);
+            addVariable("CONTENT_TYPE", content_type);
         }
-        else if (bytes == 0)
+        if (!content_length.empty())
         {
-            break;
+            addVariable("CONTENT_LENGTH", content_length);
         }
-        usleep(10000);
     }
-    close(pipe_out[0]);
-    if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
+    addVariable("REMOTE_ADDR", remote_addr);
+    addVariable("REMOTE_HOST", remote_addr);
+    buildEnvArray();
+}
+
+void CGI::addVariable(const char *name, const std::string &value)
+{
+    env_ += name;
+    env_ += '=';
+    env_ += value;
+    env_ += '\0';
+}
+
+void CGI::buildEnvArray()
+{
+    envp_.clear();
+    for (size_t pos = 0; pos < env_.size(); pos = env_.find('\0', pos) + 1)
     {
-        return (generateErrorResponse(500, "CGI script error"));
+        envp_.push_back(&env_[pos]);
     }
-    return (parseCGIOutput(output));
+    envp_.push_back(NULL);
 }
 
 std::string CGI::parseCGIOutput(const std::string &raw_output)
 {
-    if (raw_output.empty())
+    if (raw_output.empty() && !head_parsed_)
     {
         return generateErrorResponse(500, "Empty CGI response");
     }
+    if (!parseHead())
+    {
+        return "HTTP/1.1 200 OK\r\n"
+               "Content-Type: text/html\r\n"
+               "Content-Length: " +
+               toString(raw_output.length()) + "\r\n"
+                                               "Connection: close\r\n"
+                                               "\r\n" +
+               raw_output;
+    }
+    if (head_has_length_)
+    {
+        return head_ + "\r\n" + output_;
+    }
+    return head_ + "Content-Length: " + toString(output_.length()) + "\r\n\r\n" + output_;
+}
 
-    size_t separator = raw_output.find("\r\n\r\n");
-    bool use_crlf = true;
+bool CGI::parseHead()
+{
+    if (head_parsed_)
+    {
+        return (true);
+    }
+    size_t separator = output_.find("\r\n\r\n");
+    size_t length = 4;
     if (separator == std::string::npos)
     {
-        separator = raw_output.find("\n\n");
-        use_crlf = false;
+        separator = output_.find("\n\n");
+        length = 2;
         if (separator == std::string::npos)
         {
-
-            return "HTTP/1.1 200 OK\r\n"
-                   "Content-Type: text/html\r\n"
-                   "Content-Length: " +
-                   toString(raw_output.length()) + "\r\n"
-                                                   "Connection: close\r\n"
-                                                   "\r\n" +
-                   raw_output;
+            return (false);
         }
     }
+    head_ = buildHead(output_.substr(0, separator));
+    output_.erase(0, separator + length);
+    head_parsed_ = true;
+    return (true);
+}
 
-    std::string headers = raw_output.substr(0, separator);
-    std::string body = raw_output.substr(separator + (use_crlf ? 4 : 2));
-
+std::string CGI::buildHead(const std::string &headers)
+{
     std::ostringstream response;
 
     std::string status_code = "200";
@@ -410,19 +563,12 @@ std::string CGI::parseCGIOutput(const std::string &raw_output)
         response << "Content-Type: " << content_type_value << "\r\n";
     }
 
-    if (!has_content_length)
-    {
-        response << "Content-Length: " << body.length() << "\r\n";
-    }
+    head_has_length_ = has_content_length;
 
     response << "Server: webserv/1.0\r\n";
 
     response << "Connection: close\r\n";
 
-    response << "\r\n";
-
-    response << body;
-
     return response.str();
 }
 
@@ -462,23 +608,6 @@ std::string CGI::getDirectoryPath(const std::string &file_path)
     return ("");
 }
 
-std::string CGI::toUpperSnakeCase(const std::string &str)
-{
-    std::string result;
-    for (size_t i = 0; i < str.length(); ++i)
-    {
-        if (str[i] == '-')
-        {
-            result += '_';
-        }
-        else
-        {
-            result += std::toupper(str[i]);
-        }
-    }
-    return (result);
-}
-
 std::string CGI::toString(int num)
 {
     std::ostringstream oss;
@@ -498,6 +627,10 @@ std::string CGI::getStatusMessage(int code)
         return ("Not Found");
     case 500:
         return ("Internal Server Error");
+    case 502:
+        return ("Bad Gateway");
+    case 503:
+        return ("Service Unavailable");
     case 504:
         return ("Gateway Timeout");
     default:
@@ -0,0 +1,260 @@
+#include "../inc/CGICache.hpp"
+#include "../inc/utils.hpp"
+#include <cstring>
+
+static const time_t PASS_SECONDS = 10;
+
+static std::string headerValue(const std::string &head, const std::string &name)
+{
+    size_t pos = head.find("\r\n" + name + ":");
+
+    if (pos == std::string::npos)
+    {
+        return "";
+    }
+    pos += name.length() + 3;
+    return trim(head.substr(pos, head.find("\r\n", pos) - pos));
+}
+
+static bool directive(const std::vector<std::string> &directives, const std::string &name,
+                      long &value)
+{
+    for (size_t i = 0; i < directives.size(); i++)
+    {
+        std::string item = trim(directives[i]);
+        if (item == name)
+        {
+            value = 0;
+            return (true);
+        }
+        if (item.compare(0, name.length() + 1, name + "=") == 0)
+        {
+            value = std::strtol(item.c_str() + name.length() + 1, NULL, 10);
+            return (true);
+        }
+    }
+    return (false);
+}
+
+static bool parseDate(const std::string &value, time_t &result)
+{
+    struct tm tm;
+
+    std::memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end || *end)
+    {
+        return (false);
+    }
+    result = timegm(&tm);
+    return (true);
+}
+
+static bool freshness(const std::string &response, time_t now, time_t &lifetime, time_t &stale)
+{
+    size_t head_end = response.find("\r\n\r\n");
+    long value;
+
+    if (head_end == std::string::npos || response.length() < 12)
+    {
+        return (false);
+    }
+    std::string status = response.substr(9, 3);
+    if (status != "200" && status != "203" && status != "301" && status != "404" &&
+        status != "410")
+    {
+        return (false);
+    }
+    std::string head = toLowerCase(response.substr(0, head_end + 2));
+    if (head.find("\r\nset-cookie:") != std::string::npos || headerValue(head, "vary") == "*")
+    {
+        return (false);
+    }
+    std::vector<std::string> directives = split(headerValue(head, "cache-control"), ',');
+    if (directive(directives, "no-store", value) || directive(directives, "no-cache", value) ||
+        directive(directives, "private", value))
+    {
+        return (false);
+    }
+    stale = directive(directives, "stale-while-revalidate", value) ? value : 0;
+    time_t expires;
+    if (directive(directives, "s-maxage", value) || directive(directives, "max-age", value))
+    {
+        lifetime = value;
+    }
+    else if (parseDate(headerValue(head, "expires"), expires))
+    {
+        time_t date;
+        lifetime = expires - (parseDate(headerValue(head, "date"), date) ? date : now);
+    }
+    else
+    {
+        return (false);
+    }
+    if (lifetime < 0)
+    {
+        lifetime = 0;
+    }
+    return (lifetime > 0 || stale > 0);
+}
+
+CGICache::CGICache(size_t max_bytes, size_t max_entry) : _entries(), _locks(), _bytes(0),
+                                                         _max_bytes(max_bytes),
+                                                         _max_entry(max_entry), _tick(0)
+{
+}
+
+CGICache::~CGICache()
+{
+}
+
+size_t CGICache::maxEntry() const
+{
+    return _max_entry;
+}
+
+CGICache::Result CGICache::lookup(const std::string &key, time_t now, std::string &response,
+                                  time_t &age)
+{
+    std::map<std::string, Entry>::iterator it = _entries.find(key);
+
+    if (it == _entries.end())
+    {
+        return (MISS);
+    }
+    if (it->second.pass)
+    {
+        if (now < it->second.fresh_until)
+        {
+            return (PASS);
+        }
+        erase(it);
+        return (MISS);
+    }
+    if (now >= it->second.stale_until)
+    {
+        erase(it);
+        return (MISS);
+    }
+    it->second.used = ++_tick;
+    response = it->second.response;
+    age = now - it->second.stored;
+    return (now < it->second.fresh_until ? HIT : STALE);
+}
+
+void CGICache::store(const std::string &key, const std::string &response, time_t now)
+{
+    time_t lifetime;
+    time_t stale;
+
+    if (!freshness(response, now, lifetime, stale))
+    {
+        std::map<std::string, Entry>::iterator it = _entries.find(key);
+        if (it != _entries.end() && !it->second.pass && now < it->second.stale_until &&
+            response.compare(0, 10, "HTTP/1.1 5") == 0)
+        {
+            return;
+        }
+        pass(key, now);
+        return;
+    }
+    size_t size = key.size() + response.size();
+    if (response.size() > _max_entry || size > _max_bytes)
+    {
+        pass(key, now);
+        return;
+    }
+    std::map<std::string, Entry>::iterator it = _entries.find(key);
+    if (it != _entries.end())
+    {
+        erase(it);
+    }
+    evict(size);
+    Entry &entry = _entries[key];
+    entry.response = response;
+    entry.size = size;
+    entry.stored = now;
+    entry.fresh_until = now + lifetime;
+    entry.stale_until = entry.fresh_until + stale;
+    entry.pass = false;
+    entry.used = ++_tick;
+    _bytes += size;
+}
+
+void CGICache::pass(const std::string &key, time_t now)
+{
+    std::map<std::string, Entry>::iterator it = _entries.find(key);
+
+    if (it != _entries.end())
+    {
+        erase(it);
+    }
+    evict(key.size());
+    Entry &entry = _entries[key];
+    entry.size = key.size();
+    entry.stored = now;
+    entry.fresh_until = now + PASS_SECONDS;
+    entry.stale_until = entry.fresh_until;
+    entry.pass = true;
+    entry.used = ++_tick;
+    _bytes += entry.size;
+}
+
+bool CGICache::lock(const std::string &key)
+{
+    if (_locks.count(key))
+    {
+        return (false);
+    }
+    _locks[key];
+    return (true);
+}
+
+void CGICache::wait(const std::string &key, int client_fd)
+{
+    _locks[key].push_back(client_fd);
+}
+
+void CGICache::cancel(const std::string &key, int client_fd)
+{
+    std::map<std::string, std::vector<int> >::iterator it = _locks.find(key);
+
+    if (it != _locks.end())
+    {
+        it->second.erase(std::remove(it->second.begin(), it->second.end(), client_fd),
+                         it->second.end());
+    }
+}
+
+void CGICache::unlock(const std::string &key, std::vector<int> &waiters)
+{
+    std::map<std::string, std::vector<int> >::iterator it = _locks.find(key);
+
+    if (it != _locks.end())
+    {
+        waiters.insert(waiters.end(), it->second.begin(), it->second.end());
+        _locks.erase(it);
+    }
+}
+
+void CGICache::erase(std::map<std::string, Entry>::iterator it)
+{
+    _bytes -= it->second.size;
+    _entries.erase(it);
+}
+
+void CGICache::evict(size_t needed)
+{
+    while (!_entries.empty() && _bytes + needed > _max_bytes)
+    {
+        std::map<std::string, Entry>::iterator oldest = _entries.begin();
+        for (std::map<std::string, Entry>::iterator it = _entries.begin(); it != _entries.end(); ++it)
+        {
+            if (it->second.used < oldest->second.used)
+            {
+                oldest = it;
+            }
+        }
+        erase(oldest);
+    }
+}
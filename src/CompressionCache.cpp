@@ -0,0 +1,111 @@
+#include "../inc/CompressionCache.hpp"
+
+CompressionCache::CompressionCache(size_t max_bytes, size_t max_entry) : _entries(), _bytes(0),
+                                                                         _max_bytes(max_bytes),
+                                                                         _max_entry(max_entry), _tick(0)
+{
+}
+
+CompressionCache::~CompressionCache()
+{
+}
+
+size_t CompressionCache::maxEntry() const
+{
+    return _max_entry;
+}
+
+const std::string *CompressionCache::find(const std::string &path, const std::string &encoding,
+                                          const struct stat &info)
+{
+    std::map<std::string, Entry>::iterator it = _entries.find(encoding + ":" + path);
+
+    if (it == _entries.end())
+    {
+        return NULL;
+    }
+    if (it->second.mtime != info.st_mtime || it->second.size != info.st_size)
+    {
+        _bytes -= it->second.data.size();
+        _entries.erase(it);
+        return NULL;
+    }
+    it->second.used = ++_tick;
+    return &it->second.data;
+}
+
+void CompressionCache::store(const std::string &path, const std::string &encoding, time_t mtime,
+                             off_t size, const std::string &data)
+{
+    std::string key = encoding + ":" + path;
+
+    if (data.size() > _max_entry || data.size() > _max_bytes)
+    {
+        return;
+    }
+    std::map<std::string, Entry>::iterator it = _entries.find(key);
+    if (it != _entries.end())
+    {
+        _bytes -= it->second.data.size();
+        _entries.erase(it);
+    }
+    evict(data.size());
+    Entry &entry = _entries[key];
+    entry.mtime = mtime;
+    entry.size = size;
+    entry.data = data;
+    entry.used = ++_tick;
+    _bytes += data.size();
+}
+
+void CompressionCache::evict(size_t needed)
+{
+    while (!_entries.empty() && _bytes + needed > _max_bytes)
+    {
+        std::map<std::string, Entry>::iterator oldest = _entries.begin();
+        for (std::map<std::string, Entry>::iterator it = _entries.begin(); it != _entries.end(); ++it)
+        {
+            if (it->second.used < oldest->second.used)
+            {
+                oldest = it;
+            }
+        }
+        _bytes -= oldest->second.data.size();
+        _entries.erase(oldest);
+    }
+}
+
+CacheFillEncoder::CacheFillEncoder(CompressionCache &cache, const std::string &path,
+                                   const std::string &encoding, const struct stat &info) : _cache(cache), _path(path),
+                                                                                           _encoding(encoding),
+                                                                                           _mtime(info.st_mtime),
+                                                                                           _size(info.st_size),
+                                                                                           _captured(), _overflow(false)
+{
+}
+
+void CacheFillEncoder::encode(const char *data, size_t len, std::string &out)
+{
+    if (!_overflow)
+    {
+        if (_captured.size() + len > _cache.maxEntry())
+        {
+            _overflow = true;
+            _captured.clear();
+        }
+        else
+        {
+            _captured.append(data, len);
+        }
+    }
+    out.append(data, len);
+}
+
+void CacheFillEncoder::finish(std::string &out)
+{
+    (void)out;
+    if (!_overflow)
+    {
+        _cache.store(_path, _encoding, _mtime, _size, _captured);
+    }
+}
@@ -1,6 +1,7 @@
 
 #include "../inc/Config.hpp"
 #include "../inc/utils.hpp"
+#include <climits>
 
 Config::Config(const std::string &file_path) : _servers()
 {
@@ -44,6 +45,85 @@ namespace
 
         return methods;
     }
+
+    bool parseSeconds(const std::string &value, time_t &seconds)
+    {
+        char *end;
+        long number = std::strtol(value.c_str(), &end, 10);
+
+        if (end == value.c_str() || number <= 0)
+        {
+            return false;
+        }
+        if (*end == 'm')
+        {
+            number *= 60;
+            end++;
+        }
+        else if (*end == 's')
+        {
+            end++;
+        }
+        if (*end)
+        {
+            return false;
+        }
+        seconds = number;
+        return true;
+    }
+
+    bool parseSize(const std::string &value, size_t &size)
+    {
+        char *end;
+        long number = std::strtol(value.c_str(), &end, 10);
+
+        if (end == value.c_str() || number <= 0)
+        {
+            return false;
+        }
+        if (*end == 'k' || *end == 'K')
+        {
+            number *= 1024;
+            end++;
+        }
+        else if (*end == 'm' || *end == 'M')
+        {
+            number *= 1024 * 1024;
+            end++;
+        }
+        if (*end)
+        {
+            return false;
+        }
+        size = number;
+        return true;
+    }
+
+    time_t requireSeconds(const std::string &directive, const std::string &value)
+    {
+        time_t seconds;
+
+        if (!parseSeconds(value, seconds))
+        {
+            throw std::runtime_error("Invalid time for " + directive + ": " + value);
+        }
+        return seconds;
+    }
+
+    size_t requireSize(const std::string &directive, const std::string &value, size_t max)
+    {
+        size_t size;
+
+        if (!parseSize(value, size))
+        {
+            throw std::runtime_error("Invalid size for " + directive + ": " + value);
+        }
+        if (size > max)
+        {
+            throw std::runtime_error("Size too large for " + directive + ": " + value);
+        }
+        return size;
+    }
 }
 
 void Config::parse(const std::string &config_file)
@@ -110,7 +190,6 @@ void Config::parseServerBlock(std::istream &file, bool *closed)
     std::string line;
     LocationConfig current_location;
     bool in_location = false;
-    bool location_open = false;
 
     while (std::getline(file, line))
     {
@@ -124,7 +203,6 @@ void Config::parseServerBlock(std::istream &file, bool *closed)
         {
             if (in_location)
             {
-                location_open = false;
                 if (current_location._root.empty() && !server._locations.empty())
                 {
                     for (size_t i = 0; i < server._locations.size(); i++)
@@ -169,6 +247,11 @@ void Config::parseServerBlock(std::istream &file, bool *closed)
             current_location = LocationConfig();
             std::string path;
             iss >> path;
+            if (path == "=" || path == "~" || path == "~*" || path == "^~")
+            {
+                current_location._modifier = path;
+                iss >> path;
+            }
 
             if (!path.empty() && path[path.length() - 1] == '{')
             {
@@ -193,7 +276,6 @@ void Config::parseServerBlock(std::istream &file, bool *closed)
                     throw std::runtime_error("Expected '{' after location directive");
                 }
             }
-            location_open = true;
         }
         else
         {
@@ -231,12 +313,19 @@ void Config::parseServerBlock(std::istream &file, bool *closed)
     {
         LocationConfig default_loc;
         default_loc._path = "/";
-        default_loc._root = "www";
+        default_loc._root = server._root.empty() ? "www" : server._root;
         default_loc._index_file = "index.html";
         default_loc._directory_listing = false;
         default_loc._allowed_methods.push_back("GET");
         server._locations.insert(server._locations.begin(), default_loc);
     }
+    for (size_t i = 0; i < server._locations.size(); i++)
+    {
+        server._locations[i].buildCGIEnvironment(
+            server._server_names.empty() ? "localhost" : server._server_names[0], server._port);
+        server._locations[i].compile(server._root);
+    }
+    server.compileLocations();
 }
 
 void Config::parseServerDirective(ServerConfig &server, const std::string &directive,
@@ -244,12 +333,103 @@ void Config::parseServerDirective(ServerConfig &server, const std::string &direc
 {
     if (directive == "listen")
     {
-        server._port = atoi(value.c_str());
+        std::istringstream iss(value);
+        std::string address;
+        std::string option;
+        iss >> address;
+        if (address.compare(0, 5, "unix:") == 0)
+        {
+            server._host = address;
+            address = "0";
+        }
+        else if (!address.empty() && address[0] == '[')
+        {
+            size_t bracket = address.find(']');
+            server._host = address.substr(1, bracket == std::string::npos ? std::string::npos : bracket - 1);
+            address = (bracket != std::string::npos && address.compare(bracket, 2, "]:") == 0)
+                          ? address.substr(bracket + 2)
+                          : "80";
+        }
+        else if (address.rfind(':') != std::string::npos)
+        {
+            size_t colon = address.rfind(':');
+            server._host = address.substr(0, colon);
+            address = address.substr(colon + 1);
+        }
+        server._port = atoi(address.c_str());
+        while (iss >> option)
+        {
+            if (option == "default_server")
+            {
+                server._default_server = true;
+            }
+            else if (option == "ipv6only=on" || option == "ipv6only=off")
+            {
+                server._ipv6only = (option == "ipv6only=on");
+            }
+            else if (option.compare(0, 5, "mode=") == 0)
+            {
+                server._unix_mode = std::strtol(option.c_str() + 5, NULL, 8);
+            }
+            else if (option.compare(0, 8, "backlog=") == 0 && atoi(option.c_str() + 8) > 0)
+            {
+                server._backlog = atoi(option.c_str() + 8);
+            }
+            else if (option == "tcp_nodelay")
+            {
+                server._tcp_nodelay = true;
+            }
+            else if (option == "tcp_nopush")
+            {
+                server._tcp_nopush = true;
+            }
+            else if (option == "deferred")
+            {
+                server._defer_accept = 1;
+            }
+            else if (option.compare(0, 9, "deferred=") == 0)
+            {
+                server._defer_accept = requireSeconds("listen deferred", option.substr(9));
+            }
+            else if (option.compare(0, 9, "fastopen=") == 0 && atoi(option.c_str() + 9) > 0)
+            {
+                server._fastopen = atoi(option.c_str() + 9);
+            }
+            else if (option.compare(0, 7, "rcvbuf=") == 0 || option.compare(0, 7, "sndbuf=") == 0)
+            {
+                (option[0] == 'r' ? server._rcvbuf : server._sndbuf) =
+                    requireSize("listen " + option.substr(0, 6), option.substr(7), INT_MAX);
+            }
+        }
     }
     else if (directive == "host")
     {
         server._host = value;
     }
+    else if (directive == "client_header_timeout")
+    {
+        server._client_header_timeout = requireSeconds(directive, value);
+    }
+    else if (directive == "client_body_timeout")
+    {
+        server._client_body_timeout = requireSeconds(directive, value);
+    }
+    else if (directive == "send_timeout")
+    {
+        server._send_timeout = requireSeconds(directive, value);
+    }
+    else if (directive == "recv_buffer_size")
+    {
+        server._recv_buffer_size = requireSize(directive, value, INT_MAX);
+        if (server._recv_buffer_size < 1024)
+        {
+            throw std::runtime_error("Size too small for " + directive + ": " + value);
+        }
+    }
+    else if (directive == "client_header_buffer_size")
+    {
+        server._client_header_buffer_size = requireSize(directive, value, INT_MAX);
+    }
     else if (directive == "server_name")
     {
         std::istringstream iss(value);
@@ -276,6 +456,7 @@ void Config::parseServerDirective(ServerConfig &server, const std::string &direc
     }
     else if (directive == "root")
     {
+        server._root = value;
     }
     else if (directive == "index")
     {
@@ -297,6 +478,17 @@ void Config::parseLocationDirective(LocationConfig &location, const std::string
     {
         location._directory_listing = (value == "on");
     }
+    else if (directive == "autoindex_format")
+    {
+        if (value == "json" || value == "html")
+        {
+            location._autoindex_format = value;
+        }
+        else
+        {
+            std::cerr << "Warning: unknown autoindex_format: " << value << std::endl;
+        }
+    }
     else if (directive == "allow")
     {
         location._allowed_methods = parseMethods(value);
@@ -315,6 +507,82 @@ void Config::parseLocationDirective(LocationConfig &location, const std::string
             std::cerr << "Please verify the path or install the interpreter." << std::endl;
         }
     }
+    else if (directive == "fastcgi_pass")
+    {
+        location._fastcgi_pass = value;
+    }
+    else if (directive == "cgi_pool")
+    {
+        location._cgi_pool = value;
+        if (!fileExists(value))
+        {
+            std::cerr << "Warning: CGI pool worker not found: " << value << std::endl;
+        }
+    }
+    else if (directive == "cgi_pool_workers")
+    {
+        std::istringstream iss(value);
+        size_t idle;
+        size_t max;
+        if (iss >> idle >> max && max > 0)
+        {
+            location._cgi_pool_idle = std::min(idle, max);
+            location._cgi_pool_max = max;
+        }
+    }
+    else if (directive == "cgi_pool_requests")
+    {
+        std::istringstream iss(value);
+        size_t requests;
+        if (iss >> requests && requests > 0)
+        {
+            location._cgi_pool_requests = requests;
+        }
+    }
+    else if (directive == "handler_module")
+    {
+        location._handler_module = value;
+        if (!fileExists(value))
+        {
+            std::cerr << "Warning: handler module not found: " << value << std::endl;
+        }
+    }
+    else if (directive == "cgi_max_concurrency")
+    {
+        std::istringstream iss(value);
+        size_t limit;
+        if (iss >> limit)
+        {
+            location._cgi_max_concurrency = limit;
+        }
+    }
+    else if (directive == "cgi_queue_size")
+    {
+        std::istringstream iss(value);
+        size_t size;
+        if (iss >> size)
+        {
+            location._cgi_queue_size = size;
+        }
+    }
+    else if (directive == "cgi_timeout")
+    {
+        location._cgi_timeout = requireSeconds(directive, value);
+    }
+    else if (directive == "cgi_cache")
+    {
+        location._cgi_cache = (value == "on");
+    }
+    else if (directive == "cgi_cache_key_headers")
+    {
+        std::istringstream iss(value);
+        std::string header;
+        location._cgi_cache_key_headers.clear();
+        while (iss >> header)
+        {
+            location._cgi_cache_key_headers.push_back(toLowerCase(header));
+        }
+    }
     else if (directive == "cgi_extension" || directive == "cgi_ext")
     {
         location._cgi_extension = value;
@@ -330,6 +598,37 @@ void Config::parseLocationDirective(LocationConfig &location, const std::string
     else if (directive == "client_max_body_size")
     {
     }
+    else if (directive == "gzip_static")
+    {
+        location._gzip_static = (value == "on");
+    }
+    else if (directive == "gzip")
+    {
+        location._gzip = (value == "on");
+    }
+    else if (directive == "gzip_types")
+    {
+        std::istringstream iss(value);
+        std::string type;
+        location._gzip_types.clear();
+        while (iss >> type)
+        {
+            location._gzip_types.push_back(toLowerCase(type));
+        }
+    }
+    else if (directive == "gzip_min_length")
+    {
+        std::istringstream iss(value);
+        size_t length;
+        if (iss >> length)
+        {
+            location._gzip_min_length = length;
+        }
+    }
+    else if (directive == "metrics")
+    {
+        location._metrics = (value == "on");
+    }
     else if (directive == "alias")
     {
 
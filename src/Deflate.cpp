@@ -0,0 +1,504 @@
+#include "../inc/Deflate.hpp"
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+static const size_t WINDOW_SIZE = 32768;
+static const size_t BLOCK_INPUT = 65536;
+static const size_t HASH_SIZE = 1 << 15;
+static const int MAX_CHAIN = 64;
+static const size_t MIN_MATCH = 3;
+static const size_t MAX_MATCH = 258;
+
+static const unsigned short LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const unsigned char LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const unsigned short DIST_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const unsigned char DIST_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const unsigned char CL_ORDER[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+namespace
+{
+    unsigned long crcTable[256];
+    bool crcReady = false;
+
+    void initCrcTable()
+    {
+        for (unsigned long n = 0; n < 256; ++n)
+        {
+            unsigned long c = n;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = (c & 1) ? (0xEDB88320UL ^ (c >> 1)) : (c >> 1);
+            }
+            crcTable[n] = c;
+        }
+        crcReady = true;
+    }
+
+    int lengthCode(size_t length)
+    {
+        return static_cast<int>(std::upper_bound(LENGTH_BASE, LENGTH_BASE + 29, length) - LENGTH_BASE) - 1;
+    }
+
+    int distCode(size_t dist)
+    {
+        return static_cast<int>(std::upper_bound(DIST_BASE, DIST_BASE + 30, dist) - DIST_BASE) - 1;
+    }
+
+    void buildLengths(std::vector<unsigned long> freqs, int limit, std::vector<int> &lengths)
+    {
+        size_t n = freqs.size();
+        lengths.assign(n, 0);
+        while (true)
+        {
+            std::priority_queue<std::pair<unsigned long, int>,
+                                std::vector<std::pair<unsigned long, int> >,
+                                std::greater<std::pair<unsigned long, int> > > heap;
+            std::vector<int> parent(n * 2, -1);
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (freqs[i] > 0)
+                    heap.push(std::make_pair(freqs[i], static_cast<int>(i)));
+            }
+            if (heap.size() == 1)
+            {
+                lengths[heap.top().second] = 1;
+                return;
+            }
+            int next = static_cast<int>(n);
+            while (heap.size() > 1)
+            {
+                std::pair<unsigned long, int> a = heap.top();
+                heap.pop();
+                std::pair<unsigned long, int> b = heap.top();
+                heap.pop();
+                parent[a.second] = next;
+                parent[b.second] = next;
+                heap.push(std::make_pair(a.first + b.first, next));
+                ++next;
+            }
+            int longest = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                lengths[i] = 0;
+                if (freqs[i] == 0)
+                    continue;
+                for (int node = static_cast<int>(i); parent[node] != -1; node = parent[node])
+                    ++lengths[i];
+                longest = std::max(longest, lengths[i]);
+            }
+            if (longest <= limit)
+                return;
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (freqs[i] > 0)
+                    freqs[i] = (freqs[i] >> 1) + 1;
+            }
+        }
+    }
+
+    void buildCodes(const std::vector<int> &lengths, std::vector<unsigned int> &codes)
+    {
+        int bl_count[16] = {0};
+        unsigned int next_code[16] = {0};
+
+        codes.assign(lengths.size(), 0);
+        for (size_t i = 0; i < lengths.size(); ++i)
+            bl_count[lengths[i]]++;
+        bl_count[0] = 0;
+        unsigned int code = 0;
+        for (int bits = 1; bits < 16; ++bits)
+        {
+            code = (code + bl_count[bits - 1]) << 1;
+            next_code[bits] = code;
+        }
+        for (size_t i = 0; i < lengths.size(); ++i)
+        {
+            int len = lengths[i];
+            if (len == 0)
+                continue;
+            unsigned int value = next_code[len]++;
+            unsigned int reversed = 0;
+            for (int b = 0; b < len; ++b)
+            {
+                reversed = (reversed << 1) | (value & 1);
+                value >>= 1;
+            }
+            codes[i] = reversed;
+        }
+    }
+
+    void ensureTwoCodes(std::vector<unsigned long> &freqs)
+    {
+        int used = 0;
+        for (size_t i = 0; i < freqs.size() && used < 2; ++i)
+        {
+            if (freqs[i] > 0)
+                ++used;
+        }
+        for (size_t i = 0; i < freqs.size() && used < 2; ++i)
+        {
+            if (freqs[i] == 0)
+            {
+                freqs[i] = 1;
+                ++used;
+            }
+        }
+    }
+}
+
+Deflater::Deflater(Format format) : _format(format), _header_done(false), _finished(false),
+                                    _crc(0xFFFFFFFFUL), _adler(1), _total_in(0), _window(),
+                                    _history(0), _bit_buffer(0), _bit_count(0), _head(),
+                                    _prev(), _symbols(), _extras()
+{
+    if (!crcReady)
+    {
+        initCrcTable();
+    }
+}
+
+Deflater::~Deflater()
+{
+}
+
+void Deflater::compress(const char *data, size_t len, std::string &out)
+{
+    if (_finished)
+    {
+        return;
+    }
+    writeHeader(out);
+    updateChecksums(data, len);
+    _window.append(data, len);
+    if (_window.size() - _history >= BLOCK_INPUT)
+    {
+        compressPending(false, out);
+    }
+}
+
+void Deflater::finish(std::string &out)
+{
+    if (_finished)
+    {
+        return;
+    }
+    writeHeader(out);
+    compressPending(true, out);
+    flushBits(out);
+    if (_format == GZIP)
+    {
+        unsigned long crc = _crc ^ 0xFFFFFFFFUL;
+        for (int i = 0; i < 4; ++i)
+            out += static_cast<char>((crc >> (8 * i)) & 0xFF);
+        for (int i = 0; i < 4; ++i)
+            out += static_cast<char>((_total_in >> (8 * i)) & 0xFF);
+    }
+    else
+    {
+        for (int i = 3; i >= 0; --i)
+            out += static_cast<char>((_adler >> (8 * i)) & 0xFF);
+    }
+    _finished = true;
+    _window.clear();
+}
+
+void Deflater::writeHeader(std::string &out)
+{
+    if (_header_done)
+    {
+        return;
+    }
+    if (_format == GZIP)
+    {
+        static const char header[10] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, 3};
+        out.append(header, sizeof(header));
+    }
+    else
+    {
+        out += '\x78';
+        out += '\x9c';
+    }
+    _header_done = true;
+}
+
+void Deflater::updateChecksums(const char *data, size_t len)
+{
+    unsigned long a = _adler & 0xFFFF;
+    unsigned long b = (_adler >> 16) & 0xFFFF;
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        _crc = crcTable[(_crc ^ c) & 0xFF] ^ (_crc >> 8);
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    _adler = (b << 16) | a;
+    _total_in += len;
+}
+
+void Deflater::compressPending(bool final, std::string &out)
+{
+    const unsigned char *buf = reinterpret_cast<const unsigned char *>(_window.data());
+    size_t len = _window.size();
+
+    _head.assign(HASH_SIZE, -1);
+    _prev.assign(len, -1);
+    _symbols.clear();
+    _extras.clear();
+
+    for (size_t i = 0; i + 2 < _history; ++i)
+    {
+        size_t h = ((buf[i] << 10) ^ (buf[i + 1] << 5) ^ buf[i + 2]) & (HASH_SIZE - 1);
+        _prev[i] = _head[h];
+        _head[h] = static_cast<int>(i);
+    }
+
+    size_t pos = _history;
+    while (pos < len)
+    {
+        size_t best_len = 0;
+        size_t best_dist = 0;
+        if (pos + MIN_MATCH <= len)
+        {
+            size_t h = ((buf[pos] << 10) ^ (buf[pos + 1] << 5) ^ buf[pos + 2]) & (HASH_SIZE - 1);
+            size_t max_len = std::min(MAX_MATCH, len - pos);
+            int candidate = _head[h];
+            for (int chain = 0; candidate >= 0 && chain < MAX_CHAIN; ++chain)
+            {
+                size_t dist = pos - candidate;
+                if (dist > WINDOW_SIZE)
+                    break;
+                if (buf[candidate + best_len] == buf[pos + best_len])
+                {
+                    size_t n = 0;
+                    while (n < max_len && buf[candidate + n] == buf[pos + n])
+                        ++n;
+                    if (n > best_len)
+                    {
+                        best_len = n;
+                        best_dist = dist;
+                        if (n == max_len)
+                            break;
+                    }
+                }
+                candidate = _prev[candidate];
+            }
+            _prev[pos] = _head[h];
+            _head[h] = static_cast<int>(pos);
+        }
+        if (best_len >= MIN_MATCH)
+        {
+            _symbols.push_back(static_cast<unsigned short>(256 + best_len));
+            _extras.push_back(static_cast<unsigned short>(best_dist));
+            for (size_t k = 1; k < best_len; ++k)
+            {
+                size_t p = pos + k;
+                if (p + MIN_MATCH > len)
+                    break;
+                size_t h = ((buf[p] << 10) ^ (buf[p + 1] << 5) ^ buf[p + 2]) & (HASH_SIZE - 1);
+                _prev[p] = _head[h];
+                _head[h] = static_cast<int>(p);
+            }
+            pos += best_len;
+        }
+        else
+        {
+            _symbols.push_back(buf[pos]);
+            _extras.push_back(0);
+            ++pos;
+        }
+    }
+
+    emitBlock(final, out);
+
+    size_t keep = std::min(WINDOW_SIZE, _window.size());
+    _window.erase(0, _window.size() - keep);
+    _history = keep;
+}
+
+void Deflater::emitBlock(bool final, std::string &out)
+{
+    std::vector<unsigned long> ll_freq(286, 0);
+    std::vector<unsigned long> d_freq(30, 0);
+
+    for (size_t i = 0; i < _symbols.size(); ++i)
+    {
+        if (_symbols[i] < 256)
+        {
+            ll_freq[_symbols[i]]++;
+        }
+        else
+        {
+            ll_freq[257 + lengthCode(_symbols[i] - 256)]++;
+            d_freq[distCode(_extras[i])]++;
+        }
+    }
+    ll_freq[256] = 1;
+
+    std::vector<int> fixed_ll(288, 8);
+    std::vector<int> fixed_d(30, 5);
+    for (int i = 144; i < 256; ++i)
+        fixed_ll[i] = 9;
+    for (int i = 256; i < 280; ++i)
+        fixed_ll[i] = 7;
+
+    std::vector<unsigned long> dyn_ll_freq(ll_freq);
+    std::vector<unsigned long> dyn_d_freq(d_freq);
+    ensureTwoCodes(dyn_ll_freq);
+    ensureTwoCodes(dyn_d_freq);
+    std::vector<int> ll_len;
+    std::vector<int> d_len;
+    buildLengths(dyn_ll_freq, 15, ll_len);
+    buildLengths(dyn_d_freq, 15, d_len);
+
+    int hlit = 286;
+    while (hlit > 257 && ll_len[hlit - 1] == 0)
+        --hlit;
+    int hdist = 30;
+    while (hdist > 1 && d_len[hdist - 1] == 0)
+        --hdist;
+
+    std::vector<int> all(ll_len.begin(), ll_len.begin() + hlit);
+    all.insert(all.end(), d_len.begin(), d_len.begin() + hdist);
+    std::vector<int> cl_symbols;
+    std::vector<int> cl_extra;
+    for (size_t i = 0; i < all.size();)
+    {
+        size_t run = 1;
+        while (i + run < all.size() && all[i + run] == all[i])
+            ++run;
+        if (all[i] == 0 && run >= 3)
+        {
+            size_t n = std::min(run, static_cast<size_t>(138));
+            cl_symbols.push_back(n >= 11 ? 18 : 17);
+            cl_extra.push_back(static_cast<int>(n >= 11 ? n - 11 : n - 3));
+            i += n;
+        }
+        else if (all[i] != 0 && run >= 4)
+        {
+            cl_symbols.push_back(all[i]);
+            cl_extra.push_back(0);
+            size_t n = std::min(run - 1, static_cast<size_t>(6));
+            cl_symbols.push_back(16);
+            cl_extra.push_back(static_cast<int>(n - 3));
+            i += n + 1;
+        }
+        else
+        {
+            cl_symbols.push_back(all[i]);
+            cl_extra.push_back(0);
+            ++i;
+        }
+    }
+    std::vector<unsigned long> cl_freq(19, 0);
+    for (size_t i = 0; i < cl_symbols.size(); ++i)
+        cl_freq[cl_symbols[i]]++;
+    ensureTwoCodes(cl_freq);
+    std::vector<int> cl_len;
+    buildLengths(cl_freq, 7, cl_len);
+    int hclen = 19;
+    while (hclen > 4 && cl_len[CL_ORDER[hclen - 1]] == 0)
+        --hclen;
+
+    unsigned long fixed_bits = 3;
+    unsigned long dynamic_bits = 3 + 14 + 3 * hclen;
+    for (size_t i = 0; i < 286; ++i)
+    {
+        fixed_bits += ll_freq[i] * fixed_ll[i];
+        dynamic_bits += ll_freq[i] * ll_len[i];
+    }
+    for (size_t i = 0; i < 30; ++i)
+    {
+        fixed_bits += d_freq[i] * fixed_d[i];
+        dynamic_bits += d_freq[i] * d_len[i];
+    }
+    for (size_t i = 0; i < cl_symbols.size(); ++i)
+    {
+        int sym = cl_symbols[i];
+        dynamic_bits += cl_len[sym] + (sym == 16 ? 2 : sym == 17 ? 3 : sym == 18 ? 7 : 0);
+    }
+
+    std::vector<unsigned int> ll_codes;
+    std::vector<unsigned int> d_codes;
+    putBits(final ? 1 : 0, 1, out);
+    if (fixed_bits <= dynamic_bits)
+    {
+        putBits(1, 2, out);
+        ll_len = fixed_ll;
+        d_len = fixed_d;
+    }
+    else
+    {
+        std::vector<unsigned int> cl_codes;
+        buildCodes(cl_len, cl_codes);
+        putBits(2, 2, out);
+        putBits(hlit - 257, 5, out);
+        putBits(hdist - 1, 5, out);
+        putBits(hclen - 4, 4, out);
+        for (int i = 0; i < hclen; ++i)
+            putBits(cl_len[CL_ORDER[i]], 3, out);
+        for (size_t i = 0; i < cl_symbols.size(); ++i)
+        {
+            int sym = cl_symbols[i];
+            putBits(cl_codes[sym], cl_len[sym], out);
+            if (sym == 16)
+                putBits(cl_extra[i], 2, out);
+            else if (sym == 17)
+                putBits(cl_extra[i], 3, out);
+            else if (sym == 18)
+                putBits(cl_extra[i], 7, out);
+        }
+    }
+    buildCodes(ll_len, ll_codes);
+    buildCodes(d_len, d_codes);
+
+    for (size_t i = 0; i < _symbols.size(); ++i)
+    {
+        if (_symbols[i] < 256)
+        {
+            putBits(ll_codes[_symbols[i]], ll_len[_symbols[i]], out);
+            continue;
+        }
+        size_t length = _symbols[i] - 256;
+        int lc = lengthCode(length);
+        putBits(ll_codes[257 + lc], ll_len[257 + lc], out);
+        putBits(length - LENGTH_BASE[lc], LENGTH_EXTRA[lc], out);
+        int dc = distCode(_extras[i]);
+        putBits(d_codes[dc], d_len[dc], out);
+        putBits(_extras[i] - DIST_BASE[dc], DIST_EXTRA[dc], out);
+    }
+    putBits(ll_codes[256], ll_len[256], out);
+}
+
+void Deflater::putBits(unsigned long value, int count, std::string &out)
+{
+    _bit_buffer |= value << _bit_count;
+    _bit_count += count;
+    while (_bit_count >= 8)
+    {
+        out += static_cast<char>(_bit_buffer & 0xFF);
+        _bit_buffer >>= 8;
+        _bit_count -= 8;
+    }
+}
+
+void Deflater::flushBits(std::string &out)
+{
+    if (_bit_count > 0)
+    {
+        out += static_cast<char>(_bit_buffer & 0xFF);
+    }
+    _bit_buffer = 0;
+    _bit_count = 0;
+}
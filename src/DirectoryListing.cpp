@@ -0,0 +1,460 @@
+#include "../inc/DirectoryListing.hpp"
+#include "../inc/utils.hpp"
+#include <cstdlib>
+#include <fcntl.h>
+
+namespace
+{
+    struct BySize
+    {
+        const std::vector<DirectoryEntry> *entries;
+        bool operator()(size_t a, size_t b) const
+        {
+            if ((*entries)[a].size != (*entries)[b].size)
+                return (*entries)[a].size < (*entries)[b].size;
+            return a < b;
+        }
+    };
+
+    struct ByTime
+    {
+        const std::vector<DirectoryEntry> *entries;
+        bool operator()(size_t a, size_t b) const
+        {
+            if ((*entries)[a].mtime != (*entries)[b].mtime)
+                return (*entries)[a].mtime < (*entries)[b].mtime;
+            return a < b;
+        }
+    };
+
+    bool byName(const DirectoryEntry &a, const DirectoryEntry &b)
+    {
+        return a.name < b.name;
+    }
+
+    std::string toString(size_t num)
+    {
+        std::ostringstream oss;
+        oss << num;
+        return oss.str();
+    }
+}
+
+DirectorySnapshot::DirectorySnapshot() : _refs(1), _mtime(0), _mtime_nsec(0), _inode(0),
+                                         _entries(), _orders()
+{
+}
+
+DirectorySnapshot::~DirectorySnapshot()
+{
+}
+
+void DirectorySnapshot::retain()
+{
+    ++_refs;
+}
+
+void DirectorySnapshot::release()
+{
+    if (--_refs == 0)
+    {
+        delete this;
+    }
+}
+
+bool DirectorySnapshot::isCurrent(const struct stat &info) const
+{
+    return info.st_mtime == _mtime && info.st_mtim.tv_nsec == _mtime_nsec &&
+           info.st_ino == _inode;
+}
+
+const std::vector<DirectoryEntry> &DirectorySnapshot::entries() const
+{
+    return _entries;
+}
+
+// Reads and stats every entry up front: the listing header carries the
+// entry count and page total, and sorting needs the full set, so a cache
+// miss on a very large directory still delays the first byte.
+bool DirectorySnapshot::load(int dir_fd, const struct stat &info)
+{
+    struct stat child;
+    struct dirent *entry;
+
+    dir_fd = fcntl(dir_fd, F_DUPFD_CLOEXEC, 0);
+    if (dir_fd < 0)
+    {
+        return false;
+    }
+    DIR *dir = fdopendir(dir_fd);
+    if (!dir)
+    {
+        close(dir_fd);
+        return false;
+    }
+    rewinddir(dir);
+    _mtime = info.st_mtime;
+    _mtime_nsec = info.st_mtim.tv_nsec;
+    _inode = info.st_ino;
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+        if (fstatat(dir_fd, entry->d_name, &child, 0) != 0)
+        {
+            continue;
+        }
+        DirectoryEntry item;
+        item.name = entry->d_name;
+        item.is_dir = S_ISDIR(child.st_mode);
+        item.size = child.st_size;
+        item.mtime = child.st_mtime;
+        _entries.push_back(item);
+    }
+    closedir(dir);
+
+    std::sort(_entries.begin(), _entries.end(), byName);
+    return true;
+}
+
+const std::vector<size_t> &DirectorySnapshot::order(const std::string &sort)
+{
+    std::map<std::string, std::vector<size_t> >::iterator it = _orders.find(sort);
+
+    if (it != _orders.end())
+    {
+        return it->second;
+    }
+    std::vector<size_t> &indices = _orders[sort];
+    indices.resize(_entries.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        indices[i] = i;
+    }
+    if (sort == "size")
+    {
+        BySize compare;
+        compare.entries = &_entries;
+        std::sort(indices.begin(), indices.end(), compare);
+    }
+    else if (sort == "mtime")
+    {
+        ByTime compare;
+        compare.entries = &_entries;
+        std::sort(indices.begin(), indices.end(), compare);
+    }
+    return indices;
+}
+
+DirectoryCache::DirectoryCache(size_t max_directories) : _slots(), _max_directories(max_directories),
+                                                         _tick(0)
+{
+}
+
+DirectoryCache::~DirectoryCache()
+{
+    for (std::map<std::string, Slot>::iterator it = _slots.begin(); it != _slots.end(); ++it)
+    {
+        it->second.snapshot->release();
+    }
+}
+
+DirectorySnapshot *DirectoryCache::acquire(const std::string &path, int dir_fd,
+                                           const struct stat &info)
+{
+    std::map<std::string, Slot>::iterator it = _slots.find(path);
+    if (it != _slots.end())
+    {
+        if (it->second.snapshot->isCurrent(info))
+        {
+            it->second.used = ++_tick;
+            it->second.snapshot->retain();
+            return it->second.snapshot;
+        }
+        it->second.snapshot->release();
+        _slots.erase(it);
+    }
+
+    DirectorySnapshot *snapshot = new DirectorySnapshot();
+    if (!snapshot->load(dir_fd, info))
+    {
+        snapshot->release();
+        return NULL;
+    }
+    if (_slots.size() >= _max_directories && !_slots.empty())
+    {
+        std::map<std::string, Slot>::iterator oldest = _slots.begin();
+        for (it = _slots.begin(); it != _slots.end(); ++it)
+        {
+            if (it->second.used < oldest->second.used)
+            {
+                oldest = it;
+            }
+        }
+        oldest->second.snapshot->release();
+        _slots.erase(oldest);
+    }
+    Slot &slot = _slots[path];
+    slot.snapshot = snapshot;
+    slot.used = ++_tick;
+    snapshot->retain();
+    return snapshot;
+}
+
+ListingOptions parseListingOptions(const std::string &uri, const std::string &query,
+                                   bool json)
+{
+    ListingOptions options;
+    std::vector<std::string> params = split(query, '&');
+
+    options.uri = uri;
+    options.sort = "name";
+    options.descending = false;
+    options.page = 1;
+    options.limit = 0;
+    options.json = json;
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        size_t eq = params[i].find('=');
+        if (eq == std::string::npos)
+        {
+            continue;
+        }
+        std::string key = params[i].substr(0, eq);
+        std::string value = urlDecode(params[i].substr(eq + 1));
+        if (key == "sort" && (value == "name" || value == "size" || value == "mtime"))
+        {
+            options.sort = value;
+        }
+        else if (key == "order")
+        {
+            options.descending = (value == "desc");
+        }
+        else if (key == "page")
+        {
+            options.page = std::max(1L, std::strtol(value.c_str(), NULL, 10));
+        }
+        else if (key == "limit")
+        {
+            options.limit = std::max(0L, std::strtol(value.c_str(), NULL, 10));
+        }
+    }
+    return options;
+}
+
+DirectoryListingSource::DirectoryListingSource(DirectorySnapshot *snapshot,
+                                               const ListingOptions &options) : _snapshot(snapshot),
+                                                                                _options(options),
+                                                                                _stage(HEADER), _begin(0),
+                                                                                _next(0), _end(0), _pages(1)
+{
+    size_t total = _snapshot->entries().size();
+
+    _end = total;
+    if (_options.limit > 0)
+    {
+        _pages = std::max(static_cast<size_t>(1),
+                          total / _options.limit + (total % _options.limit != 0));
+        _options.page = std::min(std::max(_options.page, static_cast<size_t>(1)), _pages);
+        _next = std::min(total, (_options.page - 1) * _options.limit);
+        _end = std::min(total, _next + _options.limit);
+    }
+    _begin = _next;
+}
+
+DirectoryListingSource::~DirectoryListingSource()
+{
+    _snapshot->release();
+}
+
+bool DirectoryListingSource::produce(std::string &out, size_t max)
+{
+    if (_stage == HEADER)
+    {
+        if (_options.json)
+            writeJsonHeader(out);
+        else
+            writeHeader(out);
+        _stage = ROWS;
+    }
+    if (_stage == ROWS)
+    {
+        const std::vector<DirectoryEntry> &entries = _snapshot->entries();
+        const std::vector<size_t> *indices = NULL;
+        if (_options.sort != "name")
+        {
+            indices = &_snapshot->order(_options.sort);
+        }
+        while (_next < _end && out.size() < max)
+        {
+            size_t rank = _options.descending ? entries.size() - 1 - _next : _next;
+            const DirectoryEntry &entry = entries[indices ? (*indices)[rank] : rank];
+            if (!_options.json)
+            {
+                writeRow(entry, out);
+            }
+            else
+            {
+                if (_next != _begin)
+                    out += ",\n";
+                writeJsonRow(entry, out);
+            }
+            ++_next;
+        }
+        if (_next >= _end)
+        {
+            _stage = FOOTER;
+        }
+    }
+    if (_stage == FOOTER)
+    {
+        if (_options.json)
+            out += "\n]}\n";
+        else
+            writeFooter(out);
+        _stage = DONE;
+    }
+    return _stage != DONE;
+}
+
+std::string DirectoryListingSource::pageLink(size_t page) const
+{
+    return "?sort=" + _options.sort + "&amp;order=" + (_options.descending ? "desc" : "asc") +
+           "&amp;limit=" + toString(_options.limit) + "&amp;page=" + toString(page);
+}
+
+std::string DirectoryListingSource::sortLink(const std::string &sort) const
+{
+    bool descending = (sort == _options.sort) && !_options.descending;
+    std::string link = "?sort=" + sort + "&amp;order=" + (descending ? "desc" : "asc");
+    if (_options.limit > 0)
+    {
+        link += "&amp;limit=" + toString(_options.limit);
+    }
+    return link;
+}
+
+void DirectoryListingSource::writeHeader(std::string &out) const
+{
+    std::string uri = htmlEscape(_options.uri);
+
+    out += "<!DOCTYPE html>\n";
+    out += "<html>\n";
+    out += "<head>\n";
+    out += "  <title>Index of " + uri + "</title>\n";
+    out += "  <style>\n";
+    out += "    body { font-family: monospace; margin: 20px; }\n";
+    out += "    h1 { font-size: 24px; }\n";
+    out += "    table { border-collapse: collapse; width: 100%; }\n";
+    out += "    th, td { padding: 8px 15px; text-align: left; }\n";
+    out += "    th { background-color: #f0f0f0; border-bottom: 2px solid #ddd; }\n";
+    out += "    tr:hover { background-color: #f5f5f5; }\n";
+    out += "    a { text-decoration: none; color: #0066cc; }\n";
+    out += "    a:hover { text-decoration: underline; }\n";
+    out += "    .dir { font-weight: bold; }\n";
+    out += "    .size { text-align: right; font-family: monospace; }\n";
+    out += "    .date { font-family: monospace; }\n";
+    out += "  </style>\n";
+    out += "</head>\n";
+    out += "<body>\n";
+    out += "  <h1>Index of " + uri + "</h1>\n";
+    out += "  <hr>\n";
+    out += "  <table>\n";
+    out += "    <thead>\n";
+    out += "      <tr>\n";
+    out += "        <th><a href=\"" + sortLink("name") + "\">Name</a></th>\n";
+    out += "        <th><a href=\"" + sortLink("size") + "\">Size</a></th>\n";
+    out += "        <th><a href=\"" + sortLink("mtime") + "\">Last Modified</a></th>\n";
+    out += "      </tr>\n";
+    out += "    </thead>\n";
+    out += "    <tbody>\n";
+
+    if (_options.uri != "/")
+    {
+        out += "      <tr>\n";
+        out += "        <td><a href=\"../\" class=\"dir\">../</a></td>\n";
+        out += "        <td class=\"size\">-</td>\n";
+        out += "        <td class=\"date\">-</td>\n";
+        out += "      </tr>\n";
+    }
+}
+
+void DirectoryListingSource::writeRow(const DirectoryEntry &entry, std::string &out) const
+{
+    std::string name = htmlEscape(entry.name);
+
+    out += "      <tr>\n";
+    out += "        <td>";
+    if (entry.is_dir)
+    {
+        out += "<a href=\"" + name + "/\" class=\"dir\">" + name + "/</a>";
+    }
+    else
+    {
+        out += "<a href=\"" + name + "\">" + name + "</a>";
+    }
+    out += "</td>\n";
+    out += "        <td class=\"size\">";
+    out += entry.is_dir ? std::string("-") : formatFileSize(entry.size);
+    out += "</td>\n";
+    out += "        <td class=\"date\">" + formatTime(entry.mtime) + "</td>\n";
+    out += "      </tr>\n";
+}
+
+void DirectoryListingSource::writeJsonHeader(std::string &out) const
+{
+    out += "{\"path\":\"" + jsonEscape(_options.uri) + "\"";
+    out += ",\"total\":" + toString(_snapshot->entries().size());
+    out += ",\"sort\":\"" + _options.sort + "\"";
+    out += ",\"order\":\"" + std::string(_options.descending ? "desc" : "asc") + "\"";
+    out += ",\"page\":" + toString(_options.page);
+    out += ",\"pages\":" + toString(_pages);
+    out += ",\"limit\":" + toString(_options.limit);
+    out += ",\"next\":";
+    if (_options.limit > 0 && _options.page < _pages)
+    {
+        out += "\"" + jsonEscape(_options.uri) + "?sort=" + _options.sort + "&order=" +
+               (_options.descending ? "desc" : "asc") + "&limit=" + toString(_options.limit) +
+               "&page=" + toString(_options.page + 1) + "\"";
+    }
+    else
+    {
+        out += "null";
+    }
+    out += ",\"entries\":[\n";
+}
+
+void DirectoryListingSource::writeJsonRow(const DirectoryEntry &entry, std::string &out) const
+{
+    out += "{\"name\":\"" + jsonEscape(entry.name) + "\"";
+    out += ",\"type\":\"" + std::string(entry.is_dir ? "directory" : "file") + "\"";
+    out += ",\"size\":" + toString(static_cast<size_t>(entry.size));
+    out += ",\"mtime\":" + toString(static_cast<size_t>(entry.mtime)) + "}";
+}
+
+void DirectoryListingSource::writeFooter(std::string &out) const
+{
+    out += "    </tbody>\n";
+    out += "  </table>\n";
+    if (_options.limit > 0 && _pages > 1)
+    {
+        out += "  <p>";
+        if (_options.page > 1)
+        {
+            out += "<a href=\"" + pageLink(_options.page - 1) + "\">&larr; Previous</a> ";
+        }
+        out += "Page " + toString(_options.page) + " of " + toString(_pages);
+        if (_options.page < _pages)
+        {
+            out += " <a href=\"" + pageLink(_options.page + 1) + "\">Next &rarr;</a>";
+        }
+        out += "</p>\n";
+    }
+    out += "  <hr>\n";
+    out += "  <address>webserv/1.0 Server</address>\n";
+    out += "</body>\n";
+    out += "</html>\n";
+}
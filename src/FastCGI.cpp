@@ -0,0 +1,736 @@
+#include "../inc/FastCGI.hpp"
+#include "../inc/CGI.hpp"
+#include "../inc/Metrics.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const unsigned char FCGI_VERSION_1 = 1;
+static const unsigned char FCGI_BEGIN_REQUEST = 1;
+static const unsigned char FCGI_ABORT_REQUEST = 2;
+static const unsigned char FCGI_END_REQUEST = 3;
+static const unsigned char FCGI_PARAMS = 4;
+static const unsigned char FCGI_STDIN = 5;
+static const unsigned char FCGI_STDOUT = 6;
+static const unsigned char FCGI_STDERR = 7;
+static const unsigned char FCGI_GET_VALUES = 9;
+static const unsigned char FCGI_GET_VALUES_RESULT = 10;
+static const unsigned char FCGI_RESPONDER = 1;
+static const unsigned char FCGI_KEEP_CONN = 1;
+static const unsigned char FCGI_REQUEST_COMPLETE = 0;
+static const unsigned char FCGI_CANT_MPX_CONN = 1;
+static const unsigned char FCGI_OVERLOADED = 2;
+static const size_t RECORD_CHUNK = 65528;
+static const size_t MAX_STREAMS = 16;
+static const size_t MAX_CONNECTIONS = 16;
+static const size_t MAX_IDLE = 4;
+static const size_t MAX_BUFFERED_INPUT = 4 * RECORD_CHUNK;
+
+static void appendRecord(std::string &out, unsigned char type, unsigned short id,
+                         const char *data, size_t len)
+{
+    unsigned char padding = static_cast<unsigned char>((8 - len % 8) % 8);
+    char header[8];
+
+    header[0] = FCGI_VERSION_1;
+    header[1] = type;
+    header[2] = static_cast<char>(id >> 8);
+    header[3] = static_cast<char>(id & 0xff);
+    header[4] = static_cast<char>(len >> 8);
+    header[5] = static_cast<char>(len & 0xff);
+    header[6] = padding;
+    header[7] = 0;
+    out.append(header, sizeof(header));
+    out.append(data, len);
+    out.append(padding, '\0');
+}
+
+static void appendStream(std::string &out, unsigned char type, unsigned short id,
+                         const std::string &data)
+{
+    for (size_t offset = 0; offset < data.size(); offset += RECORD_CHUNK)
+    {
+        appendRecord(out, type, id, data.data() + offset,
+                     std::min(RECORD_CHUNK, data.size() - offset));
+    }
+    appendRecord(out, type, id, "", 0);
+}
+
+static void appendLength(std::string &out, size_t len)
+{
+    if (len < 128)
+    {
+        out += static_cast<char>(len);
+        return;
+    }
+    out += static_cast<char>(((len >> 24) & 0x7f) | 0x80);
+    out += static_cast<char>((len >> 16) & 0xff);
+    out += static_cast<char>((len >> 8) & 0xff);
+    out += static_cast<char>(len & 0xff);
+}
+
+static void appendPair(std::string &out, const std::string &name, const std::string &value)
+{
+    appendLength(out, name.size());
+    appendLength(out, value.size());
+    out += name;
+    out += value;
+}
+
+static bool readLength(const std::string &data, size_t &pos, size_t &len)
+{
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data.data());
+
+    if (pos >= data.size())
+    {
+        return false;
+    }
+    if (bytes[pos] < 128)
+    {
+        len = bytes[pos++];
+        return true;
+    }
+    if (pos + 4 > data.size())
+    {
+        return false;
+    }
+    len = (static_cast<size_t>(bytes[pos] & 0x7f) << 24) | (bytes[pos + 1] << 16) |
+          (bytes[pos + 2] << 8) | bytes[pos + 3];
+    pos += 4;
+    return true;
+}
+
+static bool readPair(const std::string &data, size_t &pos, std::string &name,
+                     std::string &value)
+{
+    size_t name_len;
+    size_t value_len;
+
+    if (!readLength(data, pos, name_len) || !readLength(data, pos, value_len) ||
+        pos + name_len + value_len > data.size())
+    {
+        return false;
+    }
+    name = data.substr(pos, name_len);
+    value = data.substr(pos + name_len, value_len);
+    pos += name_len + value_len;
+    return true;
+}
+
+FastCGIClient::FastCGIClient()
+{
+}
+
+FastCGIClient::~FastCGIClient()
+{
+    for (std::map<int, Connection *>::iterator it = _connections.begin();
+         it != _connections.end(); ++it)
+    {
+        close(it->first);
+        delete it->second;
+    }
+}
+
+void FastCGIClient::manage(const std::string &address, const std::string &interpreter,
+                           const std::string &worker, size_t idle, size_t max,
+                           size_t requests)
+{
+    Pool pool;
+
+    if (_pools.count(address))
+    {
+        return;
+    }
+    pool.interpreter = interpreter;
+    pool.worker = worker;
+    pool.idle = idle;
+    pool.max = max;
+    pool.requests = requests;
+    _pools[address] = pool;
+    trimIdle(address);
+}
+
+void FastCGIClient::submit(const std::string &address, int client_fd, CGI *cgi)
+{
+    Stream stream;
+
+    stream.client_fd = client_fd;
+    stream.cgi = cgi;
+    stream.received = false;
+    stream.retried = false;
+    stream.input_offset = 0;
+    stream.input_done = false;
+    _pending[address].push_back(stream);
+    dispatch(address);
+}
+
+void FastCGIClient::cancel(CGI *cgi)
+{
+    std::map<CGI *, std::pair<Connection *, unsigned short> >::iterator active = _active.find(cgi);
+
+    if (active != _active.end())
+    {
+        Connection *conn = active->second.first;
+        conn->streams[active->second.second].cgi = NULL;
+        _active.erase(active);
+        if (conn->pid > 0)
+        {
+            std::string address = conn->address;
+            kill(conn->pid, SIGTERM);
+            closeConnection(conn);
+            trimIdle(address);
+            return;
+        }
+        appendRecord(conn->out, FCGI_ABORT_REQUEST, active->second.second, "", 0);
+        return;
+    }
+    for (std::map<std::string, std::deque<Stream> >::iterator it = _pending.begin();
+         it != _pending.end(); ++it)
+    {
+        for (std::deque<Stream>::iterator stream = it->second.begin();
+             stream != it->second.end(); ++stream)
+        {
+            if (stream->cgi == cgi)
+            {
+                it->second.erase(stream);
+                return;
+            }
+        }
+    }
+}
+
+void FastCGIClient::handleEvent(int fd, short revents)
+{
+    std::map<int, Connection *>::iterator it = _connections.find(fd);
+    bool alive = true;
+
+    if (it == _connections.end())
+    {
+        return;
+    }
+    Connection *conn = it->second;
+    std::string address = conn->address;
+    if (conn->connecting && (revents & (POLLOUT | POLLERR | POLLHUP)))
+    {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0)
+        {
+            std::cerr << "FastCGI: cannot connect to " << address << ": "
+                      << strerror(error ? error : errno) << std::endl;
+            alive = false;
+        }
+        else
+        {
+            conn->connecting = false;
+        }
+    }
+    if (alive && !conn->connecting && (revents & POLLOUT))
+    {
+        alive = flush(conn);
+    }
+    if (alive && !conn->connecting && (revents & (POLLIN | POLLHUP | POLLERR)))
+    {
+        alive = receive(conn);
+    }
+    if (!alive)
+    {
+        closeConnection(conn);
+    }
+    dispatch(address);
+    trimIdle(address);
+}
+
+void FastCGIClient::takeCompleted(std::vector<int> &completed)
+{
+    completed.swap(_completed);
+    _completed.clear();
+}
+
+void FastCGIClient::pollFds(std::map<int, short> &fds) const
+{
+    for (std::map<int, Connection *>::const_iterator it = _connections.begin();
+         it != _connections.end(); ++it)
+    {
+        short events = POLLIN;
+        if (it->second->connecting || !it->second->out.empty())
+        {
+            events |= POLLOUT;
+        }
+        fds[it->first] = events;
+    }
+}
+
+FastCGIClient::Connection *FastCGIClient::open(const std::string &address)
+{
+    struct sockaddr_storage storage;
+    socklen_t storage_len;
+    int fd;
+
+    if (_pools.count(address))
+    {
+        return spawn(address, _pools[address]);
+    }
+    memset(&storage, 0, sizeof(storage));
+    if (address.compare(0, 5, "unix:") == 0)
+    {
+        struct sockaddr_un *un = reinterpret_cast<struct sockaddr_un *>(&storage);
+        std::string path = address.substr(5);
+        if (path.size() >= sizeof(un->sun_path))
+        {
+            std::cerr << "FastCGI: socket path too long: " << path << std::endl;
+            return NULL;
+        }
+        un->sun_family = AF_UNIX;
+        std::strcpy(un->sun_path, path.c_str());
+        storage_len = sizeof(struct sockaddr_un);
+    }
+    else
+    {
+        size_t colon = address.rfind(':');
+        std::string host = (colon == std::string::npos) ? address : address.substr(0, colon);
+        std::string port = (colon == std::string::npos) ? "9000" : address.substr(colon + 1);
+        struct addrinfo hints;
+        struct addrinfo *result;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (host.empty())
+        {
+            host = "127.0.0.1";
+        }
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0)
+        {
+            std::cerr << "FastCGI: cannot resolve " << address << std::endl;
+            return NULL;
+        }
+        memcpy(&storage, result->ai_addr, result->ai_addrlen);
+        storage_len = result->ai_addrlen;
+        freeaddrinfo(result);
+    }
+    fd = socket(storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("FastCGI socket");
+        return NULL;
+    }
+    Connection *conn = new Connection;
+    conn->fd = fd;
+    conn->pid = -1;
+    conn->served = 0;
+    conn->address = address;
+    conn->connecting = false;
+    conn->max_streams = 1;
+    conn->next_id = 1;
+    if (connect(fd, reinterpret_cast<struct sockaddr *>(&storage), storage_len) < 0)
+    {
+        if (errno != EINPROGRESS)
+        {
+            std::cerr << "FastCGI: cannot connect to " << address << ": "
+                      << strerror(errno) << std::endl;
+            close(fd);
+            delete conn;
+            return NULL;
+        }
+        conn->connecting = true;
+    }
+    std::string query;
+    appendPair(query, "FCGI_MPXS_CONNS", "");
+    appendRecord(conn->out, FCGI_GET_VALUES, 0, query.data(), query.size());
+    _connections[fd] = conn;
+    Metrics::increment("webserv_fastcgi_connections_opened_total");
+    return conn;
+}
+
+FastCGIClient::Connection *FastCGIClient::spawn(const std::string &address, const Pool &pool)
+{
+    int sockets[2];
+    posix_spawn_file_actions_t actions;
+    const char *argv[3];
+    pid_t pid;
+    int error;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) < 0)
+    {
+        perror("CGI pool socketpair");
+        return NULL;
+    }
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, sockets[1], STDIN_FILENO);
+    argv[0] = pool.interpreter.c_str();
+    argv[1] = pool.worker.c_str();
+    argv[2] = NULL;
+    error = posix_spawn(&pid, argv[0], &actions, NULL, const_cast<char **>(argv), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(sockets[1]);
+    if (error != 0)
+    {
+        std::cerr << "CGI pool: cannot execute " << pool.worker << ": "
+                  << strerror(error) << std::endl;
+        close(sockets[0]);
+        return NULL;
+    }
+    fcntl(sockets[0], F_SETFL, O_NONBLOCK);
+    Connection *conn = new Connection;
+    conn->fd = sockets[0];
+    conn->pid = pid;
+    conn->served = 0;
+    conn->address = address;
+    conn->connecting = false;
+    conn->max_streams = 1;
+    conn->next_id = 1;
+    _connections[conn->fd] = conn;
+    Metrics::increment("webserv_cgi_pool_workers_spawned_total");
+    return conn;
+}
+
+FastCGIClient::Connection *FastCGIClient::acquire(const std::string &address)
+{
+    std::map<std::string, Pool>::iterator pool = _pools.find(address);
+    size_t limit = (pool == _pools.end()) ? MAX_CONNECTIONS : pool->second.max;
+    size_t count = 0;
+
+    for (std::map<int, Connection *>::iterator it = _connections.begin();
+         it != _connections.end(); ++it)
+    {
+        if (it->second->address != address)
+        {
+            continue;
+        }
+        if (it->second->streams.size() < it->second->max_streams &&
+            (pool == _pools.end() || it->second->served < pool->second.requests))
+        {
+            return it->second;
+        }
+        count++;
+    }
+    if (count >= limit)
+    {
+        return NULL;
+    }
+    return open(address);
+}
+
+void FastCGIClient::dispatch(const std::string &address)
+{
+    std::map<std::string, std::deque<Stream> >::iterator pending = _pending.find(address);
+
+    while (pending != _pending.end() && !pending->second.empty())
+    {
+        Connection *conn = acquire(address);
+        if (conn)
+        {
+            beginRequest(conn, pending->second.front());
+            pending->second.pop_front();
+            continue;
+        }
+        bool reachable = false;
+        for (std::map<int, Connection *>::iterator it = _connections.begin();
+             it != _connections.end(); ++it)
+        {
+            reachable = reachable || it->second->address == address;
+        }
+        if (reachable)
+        {
+            break;
+        }
+        while (!pending->second.empty())
+        {
+            pending->second.front().cgi->fail(502, "Bad Gateway");
+            _completed.push_back(pending->second.front().client_fd);
+            pending->second.pop_front();
+        }
+    }
+}
+
+void FastCGIClient::beginRequest(Connection *conn, const Stream &stream)
+{
+    char *const *env = stream.cgi->getEnvironment();
+    unsigned short id;
+    char begin[8];
+    std::string params;
+
+    do
+    {
+        id = conn->next_id++;
+        if (conn->next_id == 0)
+        {
+            conn->next_id = 1;
+        }
+    } while (conn->streams.count(id));
+    memset(begin, 0, sizeof(begin));
+    begin[1] = FCGI_RESPONDER;
+    begin[2] = FCGI_KEEP_CONN;
+    appendRecord(conn->out, FCGI_BEGIN_REQUEST, id, begin, sizeof(begin));
+    for (; *env; ++env)
+    {
+        const char *separator = strchr(*env, '=');
+        appendPair(params, std::string(*env, separator - *env), separator + 1);
+    }
+    appendStream(conn->out, FCGI_PARAMS, id, params);
+    conn->streams[id] = stream;
+    conn->streams[id].input_offset = 0;
+    conn->streams[id].input_done = false;
+    _active[stream.cgi] = std::make_pair(conn, id);
+    feedInput(conn);
+    Metrics::increment("webserv_fastcgi_requests_total");
+}
+
+void FastCGIClient::feedInput(Connection *conn)
+{
+    char buffer[RECORD_CHUNK];
+
+    for (std::map<unsigned short, Stream>::iterator it = conn->streams.begin();
+         it != conn->streams.end() && conn->out.size() < MAX_BUFFERED_INPUT; ++it)
+    {
+        Stream &stream = it->second;
+        while (stream.cgi && !stream.input_done && conn->out.size() < MAX_BUFFERED_INPUT)
+        {
+            const HttpRequest &request = stream.cgi->getRequest();
+            size_t size = (request.getMethod() == "POST") ? request.getBodySize() : 0;
+            size_t len = std::min(RECORD_CHUNK, size - std::min(size, stream.input_offset));
+            const char *data = buffer;
+            if (len > 0 && request.getBodyFd() >= 0)
+            {
+                ssize_t bytes = pread(request.getBodyFd(), buffer, len, stream.input_offset);
+                len = (bytes > 0) ? bytes : 0;
+            }
+            else if (len > 0)
+            {
+                data = request.getBody().data() + stream.input_offset;
+            }
+            appendRecord(conn->out, FCGI_STDIN, it->first, data, len);
+            stream.input_offset += len;
+            stream.input_done = (len == 0);
+        }
+    }
+}
+
+bool FastCGIClient::flush(Connection *conn)
+{
+    size_t offset = 0;
+    ssize_t sent;
+
+    while (offset < conn->out.size())
+    {
+        sent = send(conn->fd, conn->out.data() + offset, conn->out.size() - offset,
+                    MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                return false;
+            }
+            break;
+        }
+        offset += sent;
+    }
+    conn->out.erase(0, offset);
+    feedInput(conn);
+    return true;
+}
+
+bool FastCGIClient::receive(Connection *conn)
+{
+    char buffer[65536];
+    ssize_t bytes;
+    bool alive = true;
+    size_t pos = 0;
+
+    while (true)
+    {
+        bytes = recv(conn->fd, buffer, sizeof(buffer), 0);
+        if (bytes > 0)
+        {
+            conn->in.append(buffer, bytes);
+            continue;
+        }
+        if (bytes == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            alive = false;
+        }
+        break;
+    }
+    while (conn->in.size() - pos >= 8)
+    {
+        const unsigned char *header = reinterpret_cast<const unsigned char *>(conn->in.data() + pos);
+        size_t length = (header[4] << 8) | header[5];
+        size_t total = 8 + length + header[6];
+        if (conn->in.size() - pos < total)
+        {
+            break;
+        }
+        handleRecord(conn, header[1], static_cast<unsigned short>((header[2] << 8) | header[3]),
+                     conn->in.substr(pos + 8, length));
+        pos += total;
+    }
+    conn->in.erase(0, pos);
+    return alive;
+}
+
+void FastCGIClient::handleRecord(Connection *conn, unsigned char type, unsigned short id,
+                                 const std::string &content)
+{
+    std::map<unsigned short, Stream>::iterator stream = conn->streams.find(id);
+
+    if (type == FCGI_STDOUT && stream != conn->streams.end() && stream->second.cgi)
+    {
+        stream->second.cgi->appendOutput(content.data(), content.size());
+        stream->second.received = true;
+    }
+    else if (type == FCGI_STDERR && !content.empty())
+    {
+        std::cerr << "FastCGI: " << content << std::endl;
+    }
+    else if (type == FCGI_END_REQUEST && stream != conn->streams.end() && content.size() >= 8)
+    {
+        unsigned char status = static_cast<unsigned char>(content[4]);
+        if (status == FCGI_CANT_MPX_CONN)
+        {
+            conn->max_streams = 1;
+            if (stream->second.cgi)
+            {
+                _active.erase(stream->second.cgi);
+                _pending[conn->address].push_front(stream->second);
+            }
+            conn->streams.erase(stream);
+        }
+        else if (status == FCGI_REQUEST_COMPLETE)
+        {
+            int app_status = static_cast<unsigned char>(content[3]);
+            finishStream(conn, id, (conn->pid > 0) ? app_status << 8 : 0, "");
+        }
+        else if (status == FCGI_OVERLOADED)
+        {
+            finishStream(conn, id, 503, "Service Unavailable");
+        }
+        else
+        {
+            finishStream(conn, id, 502, "Bad Gateway");
+        }
+    }
+    else if (type == FCGI_GET_VALUES_RESULT)
+    {
+        std::string name;
+        std::string value;
+        size_t pos = 0;
+        while (readPair(content, pos, name, value))
+        {
+            if (name == "FCGI_MPXS_CONNS" && value == "1")
+            {
+                conn->max_streams = MAX_STREAMS;
+            }
+        }
+    }
+}
+
+void FastCGIClient::finishStream(Connection *conn, unsigned short id, int code,
+                                 const std::string &message)
+{
+    Stream &stream = conn->streams[id];
+
+    conn->served++;
+    if (stream.cgi)
+    {
+        if (message.empty())
+        {
+            stream.cgi->setExitStatus(code);
+        }
+        else
+        {
+            stream.cgi->fail(code, message);
+        }
+        _active.erase(stream.cgi);
+        _completed.push_back(stream.client_fd);
+    }
+    conn->streams.erase(id);
+}
+
+void FastCGIClient::closeConnection(Connection *conn)
+{
+    std::deque<Stream> &pending = _pending[conn->address];
+
+    for (std::map<unsigned short, Stream>::iterator it = conn->streams.begin();
+         it != conn->streams.end(); ++it)
+    {
+        Stream &stream = it->second;
+        if (!stream.cgi)
+        {
+            continue;
+        }
+        _active.erase(stream.cgi);
+        if (!stream.received && !stream.retried)
+        {
+            stream.retried = true;
+            pending.push_front(stream);
+            continue;
+        }
+        stream.cgi->fail(502, "Bad Gateway");
+        _completed.push_back(stream.client_fd);
+    }
+    close(conn->fd);
+    _connections.erase(conn->fd);
+    delete conn;
+}
+
+void FastCGIClient::trimIdle(const std::string &address)
+{
+    std::map<std::string, Pool>::iterator pool = _pools.find(address);
+    size_t keep = (pool == _pools.end()) ? MAX_IDLE : pool->second.idle;
+    std::vector<Connection *> idle;
+    std::vector<Connection *> retired;
+    size_t total = 0;
+
+    for (std::map<int, Connection *>::iterator it = _connections.begin();
+         it != _connections.end(); ++it)
+    {
+        Connection *conn = it->second;
+        if (conn->address != address)
+        {
+            continue;
+        }
+        if (!conn->streams.empty() || conn->connecting || !conn->out.empty())
+        {
+            total++;
+        }
+        else if (pool != _pools.end() && conn->served >= pool->second.requests)
+        {
+            retired.push_back(conn);
+        }
+        else if (idle.size() < keep)
+        {
+            idle.push_back(conn);
+            total++;
+        }
+        else
+        {
+            retired.push_back(conn);
+        }
+    }
+    for (size_t i = 0; i < retired.size(); i++)
+    {
+        closeConnection(retired[i]);
+    }
+    if (pool == _pools.end())
+    {
+        return;
+    }
+    for (size_t i = idle.size(); i < keep && total < pool->second.max; i++, total++)
+    {
+        if (!spawn(address, pool->second))
+        {
+            break;
+        }
+    }
+}
@@ -0,0 +1,150 @@
+#include "../inc/HandlerModule.hpp"
+#include <dlfcn.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <vector>
+
+struct ModuleOutput
+{
+    HttpResponse *response;
+    StreamSource *body;
+};
+
+static void setStatus(webserv_response *response, int status)
+{
+    static_cast<ModuleOutput *>(response->context)->response->setStatusCode(status);
+}
+
+static void addHeader(webserv_response *response, const char *name, const char *value)
+{
+    static_cast<ModuleOutput *>(response->context)->response->addHeader(name, value);
+}
+
+static void writeBody(webserv_response *response, const void *data, size_t length)
+{
+    static_cast<ModuleOutput *>(response->context)->body->append(
+        std::string(static_cast<const char *>(data), length));
+}
+
+HandlerModule::HandlerModule(const std::string &path) : _path(path), _handle(NULL), _module(NULL),
+                                                        _mtime(0), _inode(0), _checked(0), _error()
+{
+}
+
+HandlerModule::~HandlerModule()
+{
+    unload();
+}
+
+const std::string &HandlerModule::getError() const
+{
+    return (_error);
+}
+
+bool HandlerModule::load()
+{
+    struct stat info;
+
+    unload();
+    if (stat(_path.c_str(), &info) != 0)
+    {
+        _error = "cannot stat " + _path;
+        return (false);
+    }
+    _mtime = info.st_mtime;
+    _inode = info.st_ino;
+    _handle = dlopen(_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!_handle)
+    {
+        _error = dlerror();
+        return (false);
+    }
+    _module = static_cast<const webserv_module *>(dlsym(_handle, WEBSERV_MODULE_SYMBOL));
+    if (!_module || _module->abi_version != WEBSERV_MODULE_ABI_VERSION || !_module->handle)
+    {
+        _error = _path + ": missing or incompatible " + WEBSERV_MODULE_SYMBOL;
+        _module = NULL;
+        unload();
+        return (false);
+    }
+    if (_module->init && _module->init() != 0)
+    {
+        _error = _path + ": init failed";
+        _module = NULL;
+        unload();
+        return (false);
+    }
+    _error.clear();
+    return (true);
+}
+
+void HandlerModule::refresh(time_t now)
+{
+    struct stat info;
+
+    if (now == _checked)
+    {
+        return;
+    }
+    _checked = now;
+    if (stat(_path.c_str(), &info) != 0 || (info.st_mtime == _mtime && info.st_ino == _inode))
+    {
+        return;
+    }
+    std::cout << "🔄 Reloading module: " << _path << std::endl;
+    if (!load())
+    {
+        std::cerr << "Module Error: " << _error << std::endl;
+    }
+}
+
+bool HandlerModule::handle(const HttpRequest &request, const std::string &remote_addr,
+                           HttpResponse &response, StreamSource &body)
+{
+    if (!_module)
+    {
+        return (false);
+    }
+    const std::string &uri = request.getUri();
+    size_t query_pos = uri.find('?');
+    std::string path = uri.substr(0, query_pos);
+    std::string query = (query_pos == std::string::npos) ? "" : uri.substr(query_pos + 1);
+    const std::map<std::string, std::string> &headers = request.getHeaders();
+    std::vector<webserv_header> list;
+    list.reserve(headers.size());
+    for (std::map<std::string, std::string>::const_iterator it = headers.begin();
+         it != headers.end(); ++it)
+    {
+        webserv_header header = {it->first.c_str(), it->second.c_str()};
+        list.push_back(header);
+    }
+    const char *data = (request.getBodyFd() >= 0) ? NULL : request.getBody().data();
+    webserv_request view = {request.getMethod().c_str(), uri.c_str(), path.c_str(), query.c_str(),
+                            request.getHttpVersion().c_str(), remote_addr.c_str(),
+                            list.empty() ? NULL : &list[0], list.size(), data,
+                            request.getBodySize(), request.getBodyFd()};
+    ModuleOutput output;
+    output.response = &response;
+    output.body = &body;
+    webserv_response out = {&output, setStatus, addHeader, writeBody};
+    response.setStatusCode(200);
+    if (_module->handle(&view, &out) != 0)
+    {
+        return (false);
+    }
+    return (true);
+}
+
+void HandlerModule::unload()
+{
+    if (_module && _module->cleanup)
+    {
+        _module->cleanup();
+    }
+    _module = NULL;
+    if (_handle)
+    {
+        dlclose(_handle);
+        _handle = NULL;
+    }
+}
@@ -7,7 +7,9 @@ HttpRequest::HttpRequest() : method_(""),
                              headers_(),
                              body_(""),
                              is_valid_(false),
-                             body_length_(0) {}
+                             body_length_(0),
+                             body_fd_(-1),
+                             body_size_(0) {}
 
 bool HttpRequest::parse(const std::string &data)
 {
@@ -168,6 +170,8 @@ void HttpRequest::clear()
     body_ = "";
     is_valid_ = false;
     body_length_ = 0;
+    body_fd_ = -1;
+    body_size_ = 0;
 }
 
 const std::string &HttpRequest::getMethod() const
@@ -187,9 +191,38 @@ const std::string &HttpRequest::getHttpVersion() const
 
 const std::string &HttpRequest::getBody() const
 {
+    char buffer[65536];
+    ssize_t bytes;
+
+    while (body_fd_ >= 0 && body_.size() < body_size_)
+    {
+        bytes = pread(body_fd_, buffer, sizeof(buffer), body_.size());
+        if (bytes <= 0)
+        {
+            break;
+        }
+        body_.append(buffer, bytes);
+    }
     return body_;
 }
 
+size_t HttpRequest::getBodySize() const
+{
+    return (body_fd_ >= 0) ? body_size_ : body_.size();
+}
+
+int HttpRequest::getBodyFd() const
+{
+    return body_fd_;
+}
+
+void HttpRequest::setBodyFile(int fd, size_t size)
+{
+    body_.clear();
+    body_fd_ = fd;
+    body_size_ = size;
+}
+
 std::string HttpRequest::getHeader(const std::string &name) const
 {
     std::string lower_name = toLowerCase(name);
@@ -80,7 +80,7 @@ std::string HttpResponse::serialize() const
         response << header_it->first << ": " << header_it->second << "\r\n";
     }
 
-    if (!body_.empty())
+    if (!body_.empty() && headers_.find("content-length") == headers_.end())
     {
         response << "content-length: " << body_.length() << "\r\n";
     }
@@ -99,22 +99,28 @@ std::string HttpResponse::serialize() const
 
 void HttpResponse::setError(int code, const std::string &message)
 {
+    static std::map<std::pair<int, std::string>, std::string> error_bodies;
+
     status_code_ = code;
     headers_["content-type"] = "text/html";
 
-    std::ostringstream error_body;
-    error_body << "<!DOCTYPE html>\n";
-    error_body << "<html>\n";
-    error_body << "<head><title>Error " << code << "</title></head>\n";
-    error_body << "<body>\n";
-    error_body << "<h1>Error " << code << "</h1>\n";
-    error_body << "<p>" << message << "</p>\n";
-    error_body << "<hr>\n";
-    error_body << "<p><i>webserv/1.0</i></p>\n";
-    error_body << "</body>\n";
-    error_body << "</html>\n";
-
-    body_ = error_body.str();
+    std::string &cached = error_bodies[std::make_pair(code, message)];
+    if (cached.empty())
+    {
+        std::ostringstream error_body;
+        error_body << "<!DOCTYPE html>\n";
+        error_body << "<html>\n";
+        error_body << "<head><title>Error " << code << "</title></head>\n";
+        error_body << "<body>\n";
+        error_body << "<h1>Error " << code << "</h1>\n";
+        error_body << "<p>" << message << "</p>\n";
+        error_body << "<hr>\n";
+        error_body << "<p><i>webserv/1.0</i></p>\n";
+        error_body << "</body>\n";
+        error_body << "</html>\n";
+        cached = error_body.str();
+    }
+    body_ = cached;
 }
 
 void HttpResponse::addHeader(const std::string &key, const std::string &value)
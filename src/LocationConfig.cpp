@@ -1,10 +1,20 @@
 
 #include "../inc/LocationConfig.hpp"
+#include <cstdlib>
+#include <sstream>
 
-LocationConfig::LocationConfig() : _path(""), _root(""), _allowed_methods(),
+LocationConfig::LocationConfig() : _path(""), _modifier(""), _root(""), _root_fd(-1),
+                                   _allowed_methods(),
+                                   _methods(~0u),
                                    _index_file(""), _directory_listing(false), _cgi_path(""),
                                    _cgi_extension(""), _upload_path(""), _redirect(""),
-                                   _client_max_body_size(0)
+                                   _client_max_body_size(0), _gzip_static(false),
+                                   _gzip(false), _gzip_types(1, "text/html"), _gzip_min_length(256),
+                                   _metrics(false), _autoindex_format("html"), _fastcgi_pass(""),
+                                   _cgi_pool(""), _cgi_pool_idle(2), _cgi_pool_max(8),
+                                   _cgi_pool_requests(1000), _cgi_max_concurrency(0),
+                                   _cgi_queue_size(32), _cgi_timeout(30), _cgi_cache(false), _cgi_cache_key_headers(),
+                                   _cgi_env(""), _handler_module("")
 {
 }
 
@@ -12,13 +22,32 @@ LocationConfig::~LocationConfig()
 {
 }
 
-LocationConfig::LocationConfig(const LocationConfig &other) : _path(other._path),
-                                                              _root(other._root), _allowed_methods(other._allowed_methods),
+LocationConfig::LocationConfig(const LocationConfig &other) : _path(other._path), _modifier(other._modifier),
+                                                              _root(other._root), _root_fd(other._root_fd),
+                                                              _allowed_methods(other._allowed_methods),
+                                                              _methods(other._methods),
                                                               _index_file(other._index_file),
                                                               _directory_listing(other._directory_listing), _cgi_path(other._cgi_path),
                                                               _cgi_extension(other._cgi_extension), _upload_path(other._upload_path),
                                                               _redirect(other._redirect),
-                                                              _client_max_body_size(other._client_max_body_size)
+                                                              _client_max_body_size(other._client_max_body_size),
+                                                              _gzip_static(other._gzip_static), _gzip(other._gzip),
+                                                              _gzip_types(other._gzip_types),
+                                                              _gzip_min_length(other._gzip_min_length),
+                                                              _metrics(other._metrics),
+                                                              _autoindex_format(other._autoindex_format),
+                                                              _fastcgi_pass(other._fastcgi_pass),
+                                                              _cgi_pool(other._cgi_pool),
+                                                              _cgi_pool_idle(other._cgi_pool_idle),
+                                                              _cgi_pool_max(other._cgi_pool_max),
+                                                              _cgi_pool_requests(other._cgi_pool_requests),
+                                                              _cgi_max_concurrency(other._cgi_max_concurrency),
+                                                              _cgi_queue_size(other._cgi_queue_size),
+                                                              _cgi_timeout(other._cgi_timeout),
+                                                              _cgi_cache(other._cgi_cache),
+                                                              _cgi_cache_key_headers(other._cgi_cache_key_headers),
+                                                              _cgi_env(other._cgi_env),
+                                                              _handler_module(other._handler_module)
 {
 }
 
@@ -27,8 +56,11 @@ LocationConfig &LocationConfig::operator=(const LocationConfig &other)
     if (this != &other)
     {
         _path = other._path;
+        _modifier = other._modifier;
         _root = other._root;
+        _root_fd = other._root_fd;
         _allowed_methods = other._allowed_methods;
+        _methods = other._methods;
         _index_file = other._index_file;
         _directory_listing = other._directory_listing;
         _cgi_path = other._cgi_path;
@@ -36,6 +68,102 @@ LocationConfig &LocationConfig::operator=(const LocationConfig &other)
         _upload_path = other._upload_path;
         _redirect = other._redirect;
         _client_max_body_size = other._client_max_body_size;
+        _gzip_static = other._gzip_static;
+        _gzip = other._gzip;
+        _gzip_types = other._gzip_types;
+        _gzip_min_length = other._gzip_min_length;
+        _metrics = other._metrics;
+        _autoindex_format = other._autoindex_format;
+        _fastcgi_pass = other._fastcgi_pass;
+        _cgi_pool = other._cgi_pool;
+        _cgi_pool_idle = other._cgi_pool_idle;
+        _cgi_pool_max = other._cgi_pool_max;
+        _cgi_pool_requests = other._cgi_pool_requests;
+        _cgi_max_concurrency = other._cgi_max_concurrency;
+        _cgi_queue_size = other._cgi_queue_size;
+        _cgi_timeout = other._cgi_timeout;
+        _cgi_cache = other._cgi_cache;
+        _cgi_cache_key_headers = other._cgi_cache_key_headers;
+        _cgi_env = other._cgi_env;
+        _handler_module = other._handler_module;
     }
     return (*this);
 }
+
+void LocationConfig::buildCGIEnvironment(const std::string &server_name, int port)
+{
+    std::ostringstream env;
+    const char *path = getenv("PATH");
+
+    env << "GATEWAY_INTERFACE=CGI/1.1" << '\0'
+        << "SERVER_SOFTWARE=webserv/1.0" << '\0'
+        << "SERVER_NAME=" << server_name << '\0'
+        << "SERVER_PORT=" << port << '\0'
+        << "PATH=" << (path ? path : "/usr/local/bin:/usr/bin:/bin") << '\0';
+    _cgi_env = env.str();
+}
+
+static void stripTrailingSlashes(std::string &path)
+{
+    while (path.length() > 1 && path[path.length() - 1] == '/')
+    {
+        path.erase(path.length() - 1);
+    }
+}
+
+unsigned int LocationConfig::methodBit(const std::string &method)
+{
+    if (method == "GET")
+        return (METHOD_GET);
+    if (method == "HEAD")
+        return (METHOD_HEAD);
+    if (method == "POST")
+        return (METHOD_POST);
+    if (method == "PUT")
+        return (METHOD_PUT);
+    if (method == "DELETE")
+        return (METHOD_DELETE);
+    return (METHOD_OTHER);
+}
+
+void LocationConfig::compile(const std::string &server_root)
+{
+    if (_root.empty())
+    {
+        _root = server_root;
+    }
+    stripTrailingSlashes(_root);
+    stripTrailingSlashes(_upload_path);
+    _methods = _allowed_methods.empty() ? ~0u : 0;
+    for (size_t i = 0; i < _allowed_methods.size(); i++)
+    {
+        _methods |= methodBit(_allowed_methods[i]);
+    }
+}
+
+bool LocationConfig::allows(const std::string &method) const
+{
+    return ((_methods & methodBit(method)) != 0);
+}
+
+bool LocationConfig::resolvePath(const std::string &uri, std::string &path) const
+{
+    size_t offset = 0;
+
+    if (_root.empty() || uri.empty() || uri[0] != '/' || uri.find("/../") != std::string::npos ||
+        (uri.length() >= 3 && uri.compare(uri.length() - 3, 3, "/..") == 0))
+    {
+        return (false);
+    }
+    if (_path != "/" && (_modifier.empty() || _modifier[0] != '~') && uri.compare(0, _path.length(), _path) == 0)
+    {
+        if (uri.length() == _path.length() || uri[_path.length()] == '/')
+        {
+            offset = _path.length();
+        }
+    }
+    path.reserve(_root.length() + uri.length() - offset);
+    path.assign(_root);
+    path.append(uri, offset, std::string::npos);
+    return (true);
+}
@@ -0,0 +1,148 @@
+#include "../inc/LocationMatcher.hpp"
+#include <iostream>
+
+LocationMatcher::LocationMatcher() : _nodes(), _exact(), _patterns(), _skip_patterns()
+{
+}
+
+LocationMatcher::~LocationMatcher()
+{
+    clear();
+}
+
+void LocationMatcher::clear()
+{
+    for (size_t i = 0; i < _patterns.size(); i++)
+    {
+        regfree(_patterns[i].compiled);
+        delete _patterns[i].compiled;
+    }
+    _patterns.clear();
+    _exact.clear();
+    _skip_patterns.clear();
+    _nodes.clear();
+}
+
+void LocationMatcher::compile(const std::vector<LocationConfig> &locations)
+{
+    clear();
+    Node root;
+    root.prefix = -1;
+    root.slash = -1;
+    _nodes.push_back(root);
+    for (size_t i = 0; i < locations.size(); i++)
+    {
+        const LocationConfig &location = locations[i];
+        _skip_patterns.push_back(location._modifier == "^~");
+        if (location._modifier == "=")
+        {
+            _exact.insert(std::make_pair(location._path, static_cast<int>(i)));
+        }
+        else if (location._modifier == "~" || location._modifier == "~*")
+        {
+            Pattern pattern;
+            pattern.compiled = new regex_t;
+            pattern.index = i;
+            int flags = REG_EXTENDED | REG_NOSUB | (location._modifier == "~*" ? REG_ICASE : 0);
+            if (regcomp(pattern.compiled, location._path.c_str(), flags) != 0)
+            {
+                std::cerr << "Warning: invalid location regex: " << location._path << std::endl;
+                delete pattern.compiled;
+                continue;
+            }
+            _patterns.push_back(pattern);
+        }
+        else
+        {
+            insert(location._path, i);
+        }
+    }
+}
+
+void LocationMatcher::insert(const std::string &path, int index)
+{
+    size_t node = 0;
+    size_t pos = 0;
+
+    if (path.empty() || path[0] != '/')
+    {
+        return;
+    }
+    while (pos + 1 < path.length())
+    {
+        size_t next = path.find('/', pos + 1);
+        if (next == std::string::npos)
+        {
+            next = path.length();
+        }
+        std::string segment = path.substr(pos + 1, next - pos - 1);
+        std::map<std::string, size_t>::iterator child = _nodes[node].children.find(segment);
+        if (child == _nodes[node].children.end())
+        {
+            Node created;
+            created.prefix = -1;
+            created.slash = -1;
+            _nodes.push_back(created);
+            child = _nodes[node].children.insert(std::make_pair(segment, _nodes.size() - 1)).first;
+        }
+        node = child->second;
+        pos = next;
+    }
+    int &slot = (pos < path.length()) ? _nodes[node].slash : _nodes[node].prefix;
+    if (slot < 0)
+    {
+        slot = index;
+    }
+}
+
+int LocationMatcher::find(const std::string &uri) const
+{
+    std::string path = uri.substr(0, uri.find('?'));
+    int best = -1;
+    size_t node = 0;
+    size_t pos = 0;
+
+    std::map<std::string, int>::const_iterator exact = _exact.find(path);
+    if (exact != _exact.end())
+    {
+        return (exact->second);
+    }
+    while (!_nodes.empty() && !path.empty() && path[0] == '/')
+    {
+        const Node &current = _nodes[node];
+        if (pos < path.length())
+        {
+            best = (current.slash >= 0) ? current.slash : (current.prefix >= 0 ? current.prefix : best);
+        }
+        else
+        {
+            best = (current.prefix >= 0) ? current.prefix : best;
+            break;
+        }
+        size_t next = path.find('/', pos + 1);
+        if (next == std::string::npos)
+        {
+            next = path.length();
+        }
+        std::map<std::string, size_t>::const_iterator child =
+            current.children.find(path.substr(pos + 1, next - pos - 1));
+        if (child == current.children.end())
+        {
+            break;
+        }
+        node = child->second;
+        pos = next;
+    }
+    if (best >= 0 && _skip_patterns[best])
+    {
+        return (best);
+    }
+    for (size_t i = 0; i < _patterns.size(); i++)
+    {
+        if (regexec(_patterns[i].compiled, path.c_str(), 0, NULL, 0) == 0)
+        {
+            return (_patterns[i].index);
+        }
+    }
+    return (best);
+}
@@ -0,0 +1,46 @@
+#include "../inc/Metrics.hpp"
+
+std::map<std::string, long> Metrics::_values;
+
+void Metrics::increment(const std::string &name, long delta)
+{
+    _values[name] += delta;
+}
+
+void Metrics::set(const std::string &name, long value)
+{
+    _values[name] = value;
+}
+
+long Metrics::get(const std::string &name)
+{
+    std::map<std::string, long>::const_iterator it = _values.find(name);
+
+    if (it == _values.end())
+    {
+        return 0;
+    }
+    return it->second;
+}
+
+std::string Metrics::render()
+{
+    std::ostringstream out;
+
+    for (std::map<std::string, long>::const_iterator it = _values.begin();
+         it != _values.end(); ++it)
+    {
+        out << it->first << " " << it->second << "\n";
+    }
+    return out.str();
+}
+
+std::string Metrics::label(const std::string &name, const std::string &key,
+                           const std::string &value)
+{
+    if (name.empty() || name[name.length() - 1] != '}')
+    {
+        return name + "{" + key + "=\"" + value + "\"}";
+    }
+    return name.substr(0, name.length() - 1) + "," + key + "=\"" + value + "\"}";
+}
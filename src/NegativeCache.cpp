@@ -0,0 +1,168 @@
+#include "../inc/NegativeCache.hpp"
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+static const uint32_t WATCH_EVENTS = IN_CREATE | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+                                     IN_ONLYDIR;
+
+static std::string parentDirectory(const std::string &path)
+{
+    size_t slash = path.find_last_of('/');
+
+    if (slash == std::string::npos)
+    {
+        return ".";
+    }
+    if (slash == 0)
+    {
+        return "/";
+    }
+    return path.substr(0, slash);
+}
+
+NegativeCache::NegativeCache(size_t max_entries, time_t ttl) : _entries(), _watches(), _paths(),
+                                                               _max_entries(max_entries),
+                                                               _ttl(ttl), _fd(-1)
+{
+}
+
+NegativeCache::~NegativeCache()
+{
+    if (_fd >= 0)
+    {
+        close(_fd);
+    }
+}
+
+bool NegativeCache::open()
+{
+    if (_fd < 0)
+    {
+        _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+    return (_fd >= 0);
+}
+
+int NegativeCache::getFd() const
+{
+    return _fd;
+}
+
+bool NegativeCache::contains(const std::string &path, time_t now)
+{
+    std::map<std::string, time_t>::iterator it = _entries.find(path);
+
+    if (it == _entries.end())
+    {
+        return (false);
+    }
+    if (now >= it->second)
+    {
+        _entries.erase(it);
+        return (false);
+    }
+    return (true);
+}
+
+void NegativeCache::insert(const std::string &path, time_t now)
+{
+    if (_fd < 0)
+    {
+        return;
+    }
+    if (_entries.size() >= _max_entries)
+    {
+        clear();
+    }
+    int wd = watch(path);
+    if (wd < 0)
+    {
+        return;
+    }
+    _entries[path] = now + _ttl;
+    _paths[wd].insert(path);
+}
+
+int NegativeCache::watch(const std::string &path)
+{
+    std::string dir = parentDirectory(path);
+
+    while (true)
+    {
+        std::map<std::string, int>::iterator it = _watches.find(dir);
+        if (it != _watches.end())
+        {
+            return (it->second);
+        }
+        int wd = inotify_add_watch(_fd, dir.c_str(), WATCH_EVENTS);
+        if (wd >= 0)
+        {
+            _watches[dir] = wd;
+            return (wd);
+        }
+        if ((errno != ENOENT && errno != ENOTDIR) || dir == "." || dir == "/")
+        {
+            return (-1);
+        }
+        dir = parentDirectory(dir);
+    }
+}
+
+void NegativeCache::invalidate(int wd)
+{
+    std::map<int, std::set<std::string> >::iterator it = _paths.find(wd);
+
+    if (it == _paths.end())
+    {
+        return;
+    }
+    for (std::set<std::string>::iterator path = it->second.begin(); path != it->second.end(); ++path)
+    {
+        _entries.erase(*path);
+    }
+    _paths.erase(it);
+}
+
+void NegativeCache::handleEvents()
+{
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t bytes;
+
+    while ((bytes = read(_fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (char *ptr = buffer; ptr < buffer + bytes;)
+        {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                clear();
+                continue;
+            }
+            invalidate(event->wd);
+            if (event->mask & IN_IGNORED)
+            {
+                for (std::map<std::string, int>::iterator it = _watches.begin(); it != _watches.end(); ++it)
+                {
+                    if (it->second == event->wd)
+                    {
+                        _watches.erase(it);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void NegativeCache::clear()
+{
+    for (std::map<std::string, int>::iterator it = _watches.begin(); it != _watches.end(); ++it)
+    {
+        inotify_rm_watch(_fd, it->second);
+    }
+    _watches.clear();
+    _paths.clear();
+    _entries.clear();
+}
@@ -3,19 +3,56 @@
 
 ServerConfig::ServerConfig() : _port(80),
                                _host("0.0.0.0"),
+                               _default_server(false),
+                               _root(""),
                                _server_names(),
                                _error_pages(),
                                _client_max_body_size(0),
-                               _locations() {}
+                               _client_header_timeout(30),
+                               _client_body_timeout(30),
+                               _send_timeout(30),
+                               _recv_buffer_size(8192),
+                               _client_header_buffer_size(1024 * 1024),
+                               _backlog(128),
+                               _tcp_nodelay(false),
+                               _tcp_nopush(false),
+                               _defer_accept(0),
+                               _fastopen(0),
+                               _rcvbuf(0),
+                               _sndbuf(0),
+                               _ipv6only(true),
+                               _unix_mode(0),
+                               _locations(),
+                               _matcher() {}
 
 ServerConfig::~ServerConfig() {}
 
 ServerConfig::ServerConfig(const ServerConfig &other) : _port(other._port),
                                                         _host(other._host),
+                                                        _default_server(other._default_server),
+                                                        _root(other._root),
                                                         _server_names(other._server_names),
                                                         _error_pages(other._error_pages),
                                                         _client_max_body_size(other._client_max_body_size),
-                                                        _locations(other._locations) {}
+                                                        _client_header_timeout(other._client_header_timeout),
+                                                        _client_body_timeout(other._client_body_timeout),
+                                                        _send_timeout(other._send_timeout),
+                                                        _recv_buffer_size(other._recv_buffer_size),
+                                                        _client_header_buffer_size(other._client_header_buffer_size),
+                                                        _backlog(other._backlog),
+                                                        _tcp_nodelay(other._tcp_nodelay),
+                                                        _tcp_nopush(other._tcp_nopush),
+                                                        _defer_accept(other._defer_accept),
+                                                        _fastopen(other._fastopen),
+                                                        _rcvbuf(other._rcvbuf),
+                                                        _sndbuf(other._sndbuf),
+                                                        _ipv6only(other._ipv6only),
+                                                        _unix_mode(other._unix_mode),
+                                                        _locations(other._locations),
+                                                        _matcher()
+{
+    compileLocations();
+}
 
 ServerConfig &ServerConfig::operator=(const ServerConfig &other)
 {
@@ -23,10 +60,27 @@ ServerConfig &ServerConfig::operator=(const ServerConfig &other)
     {
         _port = other._port;
         _host = other._host;
+        _default_server = other._default_server;
+        _root = other._root;
         _server_names = other._server_names;
         _error_pages = other._error_pages;
         _client_max_body_size = other._client_max_body_size;
+        _client_header_timeout = other._client_header_timeout;
+        _client_body_timeout = other._client_body_timeout;
+        _send_timeout = other._send_timeout;
+        _recv_buffer_size = other._recv_buffer_size;
+        _client_header_buffer_size = other._client_header_buffer_size;
+        _backlog = other._backlog;
+        _tcp_nodelay = other._tcp_nodelay;
+        _tcp_nopush = other._tcp_nopush;
+        _defer_accept = other._defer_accept;
+        _fastopen = other._fastopen;
+        _rcvbuf = other._rcvbuf;
+        _sndbuf = other._sndbuf;
+        _ipv6only = other._ipv6only;
+        _unix_mode = other._unix_mode;
         _locations = other._locations;
+        compileLocations();
     }
     return *this;
 }
@@ -57,33 +111,18 @@ const LocationConfig &ServerConfig::findLocationForRequest(const std::string &ur
             default_location._index_file = "index.html";
             default_location._directory_listing = false;
             default_location._allowed_methods.push_back("GET");
+            default_location.compile("");
             initialized = true;
         }
 
         return default_location;
     }
 
-    const LocationConfig *best_match = &_locations[0];
-    size_t best_length = 0;
-
-    for (std::vector<LocationConfig>::const_iterator it = _locations.begin();
-         it != _locations.end(); ++it)
-    {
-        const std::string &loc_path = it->_path;
-        const size_t loc_len = loc_path.length();
-
-        if ((uri_path == loc_path) ||
-            (uri_path.compare(0, loc_len, loc_path) == 0 &&
-             (loc_path[loc_path.size() - 1] == '/' ||
-              (uri_path.length() > loc_len && uri_path[loc_len] == '/'))))
-        {
-            if (loc_len > best_length)
-            {
-                best_length = loc_len;
-                best_match = &(*it);
-            }
-        }
-    }
+    int index = _matcher.find(uri_path);
+    return _locations[index >= 0 ? index : 0];
+}
 
-    return *best_match;
+void ServerConfig::compileLocations()
+{
+    _matcher.compile(_locations);
 }
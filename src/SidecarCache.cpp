@@ -0,0 +1,63 @@
+#include "../inc/SidecarCache.hpp"
+#include "../inc/utils.hpp"
+
+SidecarCache::SidecarCache() : _entries()
+{
+}
+
+SidecarCache::~SidecarCache()
+{
+}
+
+void SidecarCache::clear()
+{
+    _entries.clear();
+}
+
+bool SidecarCache::isFresh(const std::string &sidecar, time_t source_mtime)
+{
+    struct stat info;
+
+    if (stat(sidecar.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        return false;
+    }
+    return info.st_mtime >= source_mtime;
+}
+
+std::string SidecarCache::select(const std::string &path, const struct stat &info,
+                                 const std::string &accept_encoding, std::string &encoding)
+{
+    time_t now = time(NULL);
+
+    encoding.clear();
+    std::map<std::string, Entry>::iterator it = _entries.find(path);
+    if (it == _entries.end() || it->second.mtime != info.st_mtime ||
+        it->second.size != info.st_size || now - it->second.checked > RECHECK_SECONDS)
+    {
+        if (it == _entries.end() && _entries.size() >= MAX_ENTRIES)
+        {
+            _entries.clear();
+        }
+        Entry entry;
+        entry.checked = now;
+        entry.mtime = info.st_mtime;
+        entry.size = info.st_size;
+        entry.has_br = isFresh(path + ".br", info.st_mtime);
+        entry.has_gz = isFresh(path + ".gz", info.st_mtime);
+        it = _entries.insert(std::make_pair(path, entry)).first;
+        it->second = entry;
+    }
+
+    if (it->second.has_br && acceptsEncoding(accept_encoding, "br"))
+    {
+        encoding = "br";
+        return path + ".br";
+    }
+    if (it->second.has_gz && acceptsEncoding(accept_encoding, "gzip"))
+    {
+        encoding = "gzip";
+        return path + ".gz";
+    }
+    return path;
+}
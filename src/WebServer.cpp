@@ -1,132 +1,933 @@
 
 #include "../inc/CGI.hpp"
+#include "../inc/Config.hpp"
 #include "../inc/HttpRequest.hpp"
 #include "../inc/HttpResponse.hpp"
+#include "../inc/Metrics.hpp"
 #include "../inc/WebServer.hpp"
 #include "../inc/utils.hpp"
 
 static std::map<int, ClientConnection> g_clients;
-static const int BUFFER_SIZE = 8192;
-static const int TIMEOUT_SECONDS = 30;
+static const size_t BUFFER_SIZE = 8192;
+static const time_t TIMEOUT_SECONDS = 30;
+static const int DRAIN_SECONDS = 30;
+static const size_t OUTPUT_HIGH_WATER = 262144;
+static const size_t SOURCE_CHUNK = 65536;
+static const size_t SPOOL_THRESHOLD = 65536;
+static int g_signal_pipe[2] = {-1, -1};
+static volatile sig_atomic_t g_reload = 0;
+static volatile sig_atomic_t g_shutdown = 0;
+static volatile sig_atomic_t g_upgrade = 0;
+
+static void notifyChild(int)
+{
+	int saved_errno = errno;
+
+	if (write(g_signal_pipe[1], "c", 1) < 0)
+	{
+	}
+	errno = saved_errno;
+}
+
+static void requestReload(int)
+{
+	g_reload = 1;
+	notifyChild(SIGHUP);
+}
+
+static void requestShutdown(int)
+{
+	g_shutdown = 1;
+	notifyChild(SIGTERM);
+}
+
+static void requestUpgrade(int)
+{
+	g_upgrade = 1;
+	notifyChild(SIGUSR2);
+}
+
+static size_t findHeaderLine(const std::string &head, const std::string &name)
+{
+	return toLowerCase(head).find("\r\n" + toLowerCase(name) + ":");
+}
+
+static std::string getHeaderValue(const std::string &head, const std::string &name)
+{
+	size_t pos = findHeaderLine(head, name);
+	if (pos == std::string::npos)
+	{
+		return "";
+	}
+	pos += name.length() + 3;
+	return trim(head.substr(pos, head.find("\r\n", pos) - pos));
+}
+
+static void removeHeader(std::string &head, const std::string &name)
+{
+	size_t pos = findHeaderLine(head, name);
+	if (pos != std::string::npos)
+	{
+		head.erase(pos, head.find("\r\n", pos + 2) - pos);
+	}
+}
+
+static void insertHeader(std::string &head, const std::string &name,
+						 const std::string &value)
+{
+	size_t end = head.find("\r\n\r\n");
+	if (end != std::string::npos)
+	{
+		head.insert(end + 2, name + ": " + value + "\r\n");
+	}
+}
+
+static std::string negotiateEncoding(const HttpRequest &request)
+{
+	std::string accept = request.getHeader("accept-encoding");
+	if (acceptsEncoding(accept, "gzip"))
+	{
+		return ("gzip");
+	}
+	if (acceptsEncoding(accept, "deflate"))
+	{
+		return ("deflate");
+	}
+	return ("");
+}
+
+static void encodeBody(std::vector<BodyEncoder *> &encoders, size_t first,
+					   std::string data, std::string &out)
+{
+	for (size_t i = first; i < encoders.size(); i++)
+	{
+		std::string encoded;
+		encoders[i]->encode(data.data(), data.size(), encoded);
+		data.swap(encoded);
+	}
+	out += data;
+}
+
+static std::string poolAddress(const LocationConfig &location)
+{
+	return ("pool:" + location._cgi_path + " " + location._cgi_pool);
+}
+
+static void initConnection(ClientConnection &conn, int fd)
+{
+	conn.fd = fd;
+	conn.buffer = "";
+	conn.last_activity = time(NULL);
+	conn.keep_alive = false;
+	conn.server = NULL;
+	conn.vhosts = NULL;
+	conn.generation = NULL;
+	conn.needs_cookie = false;
+	conn.out_offset = 0;
+	conn.source = NULL;
+	conn.close_after_write = false;
+	conn.cgi = NULL;
+	conn.cgi_stream = NULL;
+	conn.cgi_paused = false;
+	conn.spool_fd = -1;
+	conn.spool_size = 0;
+	conn.spool_remaining = 0;
+	conn.pipelined = "";
+	conn.cgi_queued = false;
+}
+
+static long currentMillis()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000L + tv.tv_usec / 1000);
+}
+
+static const char *relativePath(const LocationConfig &location, const std::string &path)
+{
+	const char *relative = path.c_str() + location._root.length();
+
+	while (*relative == '/')
+	{
+		relative++;
+	}
+	return (*relative ? relative : ".");
+}
+
+static int openResolved(const LocationConfig &location, const std::string &path, int flags)
+{
+	if (location._root_fd < 0)
+	{
+		return (open(path.c_str(), flags));
+	}
+	return (openBeneath(location._root_fd, relativePath(location, path), flags));
+}
+
+static time_t idleTimeout(const ClientConnection &conn)
+{
+	if (!conn.server)
+	{
+		return (TIMEOUT_SECONDS);
+	}
+	if (conn.source || conn.out_offset < conn.out.size() || conn.close_after_write || conn.cgi_queued)
+	{
+		return (conn.server->_send_timeout);
+	}
+	if (conn.spool_fd >= 0 || conn.buffer.find("\r\n\r\n") != std::string::npos)
+	{
+		return (conn.server->_client_body_timeout);
+	}
+	return (conn.server->_client_header_timeout);
+}
+
+static bool isUnixListener(const std::string &host)
+{
+	return (host.compare(0, 5, "unix:") == 0);
+}
+
+static std::string listenKey(const ServerConfig &server)
+{
+	std::ostringstream key;
+
+	if (isUnixListener(server._host))
+	{
+		return (server._host);
+	}
+	if (server._host.find(':') != std::string::npos)
+	{
+		key << "[" << server._host << "]:" << server._port;
+	}
+	else
+	{
+		key << server._host << ":" << server._port;
+	}
+	return (key.str());
+}
+
+static socklen_t listenAddress(const ServerConfig &server, struct sockaddr_storage &addr)
+{
+	std::memset(&addr, 0, sizeof(addr));
+	if (isUnixListener(server._host))
+	{
+		struct sockaddr_un *un = reinterpret_cast<struct sockaddr_un *>(&addr);
+		std::string path = server._host.substr(5);
+		if (path.empty() || path.length() >= sizeof(un->sun_path))
+		{
+			return (0);
+		}
+		un->sun_family = AF_UNIX;
+		std::memcpy(un->sun_path, path.c_str(), path.length() + 1);
+		return (sizeof(struct sockaddr_un));
+	}
+	if (server._host.find(':') != std::string::npos)
+	{
+		struct sockaddr_in6 *in6 = reinterpret_cast<struct sockaddr_in6 *>(&addr);
+		in6->sin6_family = AF_INET6;
+		in6->sin6_port = htons(server._port);
+		if (inet_pton(AF_INET6, server._host.c_str(), &in6->sin6_addr) <= 0)
+		{
+			return (0);
+		}
+		return (sizeof(struct sockaddr_in6));
+	}
+	struct sockaddr_in *in = reinterpret_cast<struct sockaddr_in *>(&addr);
+	in->sin_family = AF_INET;
+	in->sin_port = htons(server._port);
+	if (server._host == "0.0.0.0" || server._host.empty())
+	{
+		in->sin_addr.s_addr = INADDR_ANY;
+	}
+	else if (server._host == "localhost")
+	{
+		in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	}
+	else if (inet_pton(AF_INET, server._host.c_str(), &in->sin_addr) <= 0)
+	{
+		return (0);
+	}
+	return (sizeof(struct sockaddr_in));
+}
+
+static bool removeStaleSocket(const struct sockaddr_un &addr)
+{
+	struct stat info;
+	int probe;
+	bool stale;
+
+	if (lstat(addr.sun_path, &info) != 0)
+	{
+		return (errno == ENOENT);
+	}
+	if (!S_ISSOCK(info.st_mode))
+	{
+		return (false);
+	}
+	probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	stale = probe >= 0 && connect(probe, reinterpret_cast<const struct sockaddr *>(&addr),
+								  sizeof(addr)) < 0 && errno == ECONNREFUSED;
+	if (probe >= 0)
+	{
+		close(probe);
+	}
+	return (stale && unlink(addr.sun_path) == 0);
+}
+
+static std::string normalizeHost(const std::string &header)
+{
+	std::string host = toLowerCase(header);
+	size_t end = (host.empty() || host[0] != '[') ? host.find(':') : host.find(']') + 1;
+
+	if (end != std::string::npos && end <= host.length())
+	{
+		host.erase(end);
+	}
+	if (!host.empty() && host[host.length() - 1] == '.')
+	{
+		host.erase(host.length() - 1);
+	}
+	return (host);
+}
+
+static const ServerConfig *findVirtualHost(const VirtualHosts &vhosts, const std::string &host)
+{
+	std::map<std::string, const ServerConfig *>::const_iterator it = vhosts.names.find(host);
+
+	if (it != vhosts.names.end())
+	{
+		return (it->second);
+	}
+	for (size_t dot = host.find('.'); dot != std::string::npos; dot = host.find('.', dot + 1))
+	{
+		it = vhosts.wildcards.find(host.substr(dot));
+		if (it != vhosts.wildcards.end())
+		{
+			return (it->second);
+		}
+	}
+	return (vhosts.default_server);
+}
+
+static std::string cacheKey(const HttpRequest &request, const LocationConfig &location)
+{
+	std::string key = request.getMethod() + " " + toLowerCase(request.getHeader("host")) +
+					  request.getUri();
+	for (size_t i = 0; i < location._cgi_cache_key_headers.size(); i++)
+	{
+		key += "\n" + location._cgi_cache_key_headers[i] + ": " +
+			   request.getHeader(location._cgi_cache_key_headers[i]);
+	}
+	return (key);
+}
+
+static void releaseBody(ClientConnection &conn)
+{
+	delete conn.source;
+	conn.source = NULL;
+	conn.cgi_stream = NULL;
+	for (size_t i = 0; i < conn.encoders.size(); i++)
+	{
+		delete conn.encoders[i];
+	}
+	conn.encoders.clear();
+}
+
+WebServer::WebServer(const std::vector<ServerConfig> &servers, const std::string &config_file,
+					 const std::string &executable) : _config_file(config_file),
+																 _executable(executable),
+																 _draining(false),
+																 _drain_deadline(0),
+																 _successor(-1),
+																 _generation(new Generation),
+																 _cgi_cache(16 * 1024 * 1024, 1024 * 1024),
+																 _next_detached_fd(-1),
+																 _compressed(32 * 1024 * 1024, 4 * 1024 * 1024),
+																 _directories(64),
+																 _missing(4096, 10)
+{
+	_generation->servers = servers;
+	_generation->connections = 0;
+	loadErrorPages(*_generation);
+}
+
+void WebServer::loadErrorPages(const Generation &generation)
+{
+	for (size_t i = 0; i < generation.servers.size(); i++)
+	{
+		const ServerConfig &server = generation.servers[i];
+		for (std::map<int, std::string>::const_iterator it = server._error_pages.begin();
+			 it != server._error_pages.end(); ++it)
+		{
+			if (it->first < 300 || it->first > 599)
+			{
+				std::cerr << "Warning: ignoring error_page for invalid status " << it->first << std::endl;
+				continue;
+			}
+			std::string page = readFile(it->second);
+			if (page.empty())
+			{
+				std::cerr << "Warning: error page " << it->first << " not found or empty: "
+						  << it->second << std::endl;
+				continue;
+			}
+			HttpResponse response;
+			response.setStatusCode(it->first);
+			response.setBody(page);
+			response.addHeader("content-type", "text/html");
+			PrebuiltResponse &prebuilt = _error_pages[std::make_pair(&server, it->first)];
+			prebuilt.response = response.serialize();
+			prebuilt.metric = Metrics::label(Metrics::label("webserv_error_pages_served_total", "server",
+															server._host + ":" + toString(server._port)),
+											 "code", toString(it->first));
+			Metrics::increment(prebuilt.metric, 0);
+		}
+	}
+}
+
+WebServer::~WebServer()
+{
+	for (size_t i = 0; i < _poll_fds.size(); i++)
+	{
+		close(_poll_fds[i].fd);
+	}
+	for (std::map<int, ClientConnection>::iterator it = g_clients.begin();
+		 it != g_clients.end(); ++it)
+	{
+		releaseBody(it->second);
+	}
+	g_clients.clear();
+	for (std::map<std::string, HandlerModule *>::iterator it = _modules.begin();
+		 it != _modules.end(); ++it)
+	{
+		delete it->second;
+	}
+	destroyGeneration(_generation);
+	for (size_t i = 0; i < _retired.size(); i++)
+	{
+		destroyGeneration(_retired[i]);
+	}
+}
+
+int WebServer::openListener(const ServerConfig &server)
+{
+	int server_fd;
+	int opt;
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
+
+	addr_len = listenAddress(server, addr);
+	if (addr_len == 0)
+	{
+		std::cerr << "Invalid address: " << server._host << std::endl;
+		return (-1);
+	}
+	server_fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (server_fd < 0)
+	{
+		perror("socket");
+		return (-1);
+	}
+	opt = 1;
+	if (addr.ss_family != AF_UNIX && setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt,
+												sizeof(opt)) < 0)
+	{
+		perror("setsockopt");
+		close(server_fd);
+		return (-1);
+	}
+	opt = server._ipv6only ? 1 : 0;
+	if (addr.ss_family == AF_INET6 &&
+		setsockopt(server_fd, IPPROTO_IPV6, IPV6_V6ONLY, &opt, sizeof(opt)) < 0)
+	{
+		perror("setsockopt IPV6_V6ONLY");
+	}
+	if (addr.ss_family == AF_UNIX &&
+		!removeStaleSocket(*reinterpret_cast<struct sockaddr_un *>(&addr)))
+	{
+		std::cerr << "Unix socket path in use: " << server._host << std::endl;
+		close(server_fd);
+		return (-1);
+	}
+	applyListenOptions(server_fd, server);
+	if (bind(server_fd, (struct sockaddr *)&addr, addr_len) < 0)
+	{
+		perror("bind");
+		close(server_fd);
+		return (-1);
+	}
+	if (addr.ss_family == AF_UNIX && server._unix_mode &&
+		chmod(server._host.c_str() + 5, server._unix_mode) < 0)
+	{
+		perror("chmod");
+	}
+	if (listen(server_fd, server._backlog) < 0)
+	{
+		perror("listen");
+		close(server_fd);
+		return (-1);
+	}
+	return (server_fd);
+}
+
+void WebServer::applyListenOptions(int server_fd, const ServerConfig &server)
+{
+	int value;
+
+	if (server._rcvbuf > 0 &&
+		setsockopt(server_fd, SOL_SOCKET, SO_RCVBUF, &server._rcvbuf, sizeof(server._rcvbuf)) < 0)
+	{
+		perror("setsockopt SO_RCVBUF");
+	}
+	if (server._sndbuf > 0 &&
+		setsockopt(server_fd, SOL_SOCKET, SO_SNDBUF, &server._sndbuf, sizeof(server._sndbuf)) < 0)
+	{
+		perror("setsockopt SO_SNDBUF");
+	}
+	if (isUnixListener(server._host))
+	{
+		return;
+	}
+	value = server._tcp_nodelay ? 1 : 0;
+	if (setsockopt(server_fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value)) < 0)
+	{
+		perror("setsockopt TCP_NODELAY");
+	}
+	if (setsockopt(server_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &server._defer_accept,
+				   sizeof(server._defer_accept)) < 0)
+	{
+		perror("setsockopt TCP_DEFER_ACCEPT");
+	}
+	if (server._fastopen > 0 &&
+		setsockopt(server_fd, IPPROTO_TCP, TCP_FASTOPEN, &server._fastopen, sizeof(server._fastopen)) < 0)
+	{
+		perror("setsockopt TCP_FASTOPEN");
+	}
+}
+
+std::map<std::string, int> WebServer::setupSockets(Generation &generation)
+{
+	int server_fd;
+	struct pollfd pfd;
+
+	std::map<std::string, int> used_addresses;
+	for (size_t i = 0; i < generation.servers.size(); i++)
+	{
+		const ServerConfig &server = generation.servers[i];
+		std::string addr_key = listenKey(server);
+		if (used_addresses.find(addr_key) != used_addresses.end())
+		{
+			std::cout << "Already listening on " << addr_key << std::endl;
+			addVirtualHost(generation.virtual_hosts[used_addresses[addr_key]], server);
+			continue;
+		}
+		std::map<std::string, int>::iterator existing = _listeners.find(addr_key);
+		std::map<std::string, int>::iterator inherited = _inherited.find(addr_key);
+		if (existing != _listeners.end())
+		{
+			server_fd = existing->second;
+			applyListenOptions(server_fd, server);
+			listen(server_fd, server._backlog);
+		}
+		else
+		{
+			if (inherited != _inherited.end())
+			{
+				server_fd = inherited->second;
+				applyListenOptions(server_fd, server);
+				listen(server_fd, server._backlog);
+				fcntl(server_fd, F_SETFD, FD_CLOEXEC);
+				fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL) | O_NONBLOCK);
+				_inherited.erase(inherited);
+			}
+			else
+			{
+				server_fd = openListener(server);
+			}
+			if (server_fd < 0)
+			{
+				continue;
+			}
+			pfd.fd = server_fd;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			_poll_fds.push_back(pfd);
+			_server_fds.push_back(server_fd);
+			_listeners[addr_key] = server_fd;
+		}
+		used_addresses[addr_key] = server_fd;
+		generation.virtual_hosts[server_fd].default_server = NULL;
+		generation.virtual_hosts[server_fd].tcp_nopush = server._tcp_nopush;
+		addVirtualHost(generation.virtual_hosts[server_fd], server);
+		std::cout << "✓ Listening on " << addr_key;
+		if (!server._server_names.empty())
+		{
+			std::cout << " (";
+			for (size_t j = 0; j < server._server_names.size(); j++)
+			{
+				if (j > 0)
+					std::cout << ", ";
+				std::cout << server._server_names[j];
+			}
+			std::cout << ")";
+		}
+		std::cout << std::endl;
+	}
+	return (used_addresses);
+}
+
+void WebServer::closeListeners(const std::map<std::string, int> &active)
+{
+	std::map<std::string, int>::iterator it = _listeners.begin();
+
+	while (it != _listeners.end())
+	{
+		if (active.count(it->first))
+		{
+			++it;
+			continue;
+		}
+		std::cout << "✗ Closed listener " << it->first << std::endl;
+		_server_fds.erase(std::remove(_server_fds.begin(), _server_fds.end(), it->second),
+						  _server_fds.end());
+		removePollFd(it->second);
+		close(it->second);
+		if (isUnixListener(it->first) && (_successor <= 0 || kill(_successor, 0) != 0))
+		{
+			unlink(it->first.c_str() + 5);
+		}
+		_listeners.erase(it++);
+	}
+}
+
+void WebServer::inheritListeners()
+{
+	const char *listeners = getenv("WEBSERV_LISTENERS");
+
+	if (!listeners)
+	{
+		return;
+	}
+	std::vector<std::string> entries = split(listeners, ';');
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		size_t equals = entries[i].rfind('=');
+		if (equals != std::string::npos)
+		{
+			_inherited[entries[i].substr(0, equals)] = atoi(entries[i].c_str() + equals + 1);
+		}
+	}
+	unsetenv("WEBSERV_LISTENERS");
+}
+
+void WebServer::shutdown()
+{
+	if (_draining)
+	{
+		std::cout << "🛑 Second shutdown signal, closing remaining connections" << std::endl;
+		_drain_deadline = 0;
+		return;
+	}
+	std::cout << "\n\n🛑 Shutting down webserv, draining " << g_clients.size()
+			  << " connection(s)..." << std::endl;
+	_draining = true;
+	_drain_deadline = time(NULL) + DRAIN_SECONDS;
+	closeListeners(std::map<std::string, int>());
+}
+
+void WebServer::drain()
+{
+	std::vector<int> idle;
+
+	for (std::map<int, ClientConnection>::iterator it = g_clients.begin(); it != g_clients.end(); ++it)
+	{
+		const ClientConnection &conn = it->second;
+		if (conn.fd >= 0 && conn.buffer.empty() && conn.spool_fd < 0 && !conn.source &&
+			conn.out_offset >= conn.out.size() && !conn.cgi && !conn.cgi_queued &&
+			conn.cache_key.empty())
+		{
+			idle.push_back(it->first);
+		}
+	}
+	for (size_t i = 0; i < idle.size(); i++)
+	{
+		removeClient(idle[i]);
+	}
+}
+
+void WebServer::upgrade()
+{
+	std::ostringstream listeners;
+	std::ostringstream parent;
+	pid_t pid;
+
+	if (_draining)
+	{
+		return;
+	}
+	for (std::map<std::string, int>::iterator it = _listeners.begin(); it != _listeners.end(); ++it)
+	{
+		listeners << it->first << "=" << it->second << ";";
+	}
+	parent << getpid();
+	pid = fork();
+	if (pid < 0)
+	{
+		perror("fork");
+		return;
+	}
+	if (pid == 0)
+	{
+		for (std::map<std::string, int>::iterator it = _listeners.begin(); it != _listeners.end(); ++it)
+		{
+			fcntl(it->second, F_SETFD, 0);
+		}
+		setenv("WEBSERV_LISTENERS", listeners.str().c_str(), 1);
+		setenv("WEBSERV_PARENT", parent.str().c_str(), 1);
+		execl(_executable.c_str(), _executable.c_str(), _config_file.c_str(), (char *)NULL);
+		perror("execl");
+		_exit(127);
+	}
+	_successor = pid;
+	std::cout << "🔁 Started " << _executable << " (pid " << pid
+			  << "), waiting for it to take over the listeners" << std::endl;
+}
+
+void WebServer::prepareLocations(Generation &generation)
+{
+	for (size_t i = 0; i < generation.servers.size(); i++)
+	{
+		for (size_t j = 0; j < generation.servers[i]._locations.size(); j++)
+		{
+			LocationConfig &location = generation.servers[i]._locations[j];
+			if (!location._root.empty())
+			{
+				if (!generation.root_fds.count(location._root))
+				{
+					generation.root_fds[location._root] = open(location._root.c_str(),
+															   O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+				}
+				location._root_fd = generation.root_fds[location._root];
+			}
+			if (!location._handler_module.empty() && !_modules.count(location._handler_module))
+			{
+				HandlerModule *module = new HandlerModule(location._handler_module);
+				if (!module->load())
+				{
+					std::cerr << "Module Error: " << module->getError() << std::endl;
+				}
+				_modules[location._handler_module] = module;
+			}
+			if (!location._cgi_pool.empty())
+			{
+				_fastcgi.manage(poolAddress(location), location._cgi_path, location._cgi_pool,
+								location._cgi_pool_idle, location._cgi_pool_max,
+								location._cgi_pool_requests);
+			}
+		}
+	}
+}
 
-WebServer::WebServer(const std::vector<ServerConfig> &servers) : _servers(servers)
+void WebServer::reload()
 {
+	Generation *generation;
+
+	std::cout << "\n🔄 Reloading configuration from " << _config_file << std::endl;
+	try
+	{
+		Config config(_config_file);
+		if (!config._valid || config.getServers().empty())
+		{
+			throw std::runtime_error("invalid configuration");
+		}
+		generation = new Generation;
+		generation->servers = config.getServers();
+		generation->connections = 0;
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << "Reload failed, keeping current configuration: " << e.what() << std::endl;
+		Metrics::increment(Metrics::label("webserv_config_reloads_total", "result", "failed"));
+		return;
+	}
+	std::map<std::string, int> active = setupSockets(*generation);
+	if (active.empty())
+	{
+		std::cerr << "Reload failed, keeping current configuration: no listener" << std::endl;
+		Metrics::increment(Metrics::label("webserv_config_reloads_total", "result", "failed"));
+		delete generation;
+		return;
+	}
+	closeListeners(active);
+	prepareLocations(*generation);
+	loadErrorPages(*generation);
+	retireGeneration(_generation);
+	_generation = generation;
+	_missing.clear();
+	Metrics::increment(Metrics::label("webserv_config_reloads_total", "result", "ok"));
+	std::cout << "✓ Configuration reloaded (" << _retired.size() << " previous generation(s) draining)" << std::endl;
 }
 
-WebServer::~WebServer()
+void WebServer::retireGeneration(Generation *generation)
 {
-	for (size_t i = 0; i < _poll_fds.size(); i++)
+	if (generation->connections == 0)
 	{
-		close(_poll_fds[i].fd);
+		destroyGeneration(generation);
+		return;
 	}
-	g_clients.clear();
+	_retired.push_back(generation);
 }
 
-void WebServer::setupSockets()
+void WebServer::destroyGeneration(Generation *generation)
 {
-	int server_fd;
-	int opt;
-	sockaddr_in addr;
-	struct pollfd pfd;
-
-	std::map<std::string, int> used_addresses;
-	for (size_t i = 0; i < _servers.size(); i++)
+	for (std::map<std::string, int>::iterator it = generation->root_fds.begin();
+		 it != generation->root_fds.end(); ++it)
 	{
-		std::ostringstream addr_key;
-		addr_key << _servers[i]._host << ":" << _servers[i]._port;
-		if (used_addresses.find(addr_key.str()) != used_addresses.end())
-		{
-			std::cout << "Already listening on " << addr_key.str() << std::endl;
-			continue;
-		}
-		server_fd = socket(AF_INET, SOCK_STREAM, 0);
-		if (server_fd < 0)
+		if (it->second >= 0)
 		{
-			perror("socket");
-			continue;
+			close(it->second);
 		}
-		opt = 1;
-		if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt,
-					   sizeof(opt)) < 0)
+	}
+	for (size_t i = 0; i < generation->servers.size(); i++)
+	{
+		for (std::map<int, std::string>::const_iterator it = generation->servers[i]._error_pages.begin();
+			 it != generation->servers[i]._error_pages.end(); ++it)
 		{
-			perror("setsockopt");
-			close(server_fd);
-			continue;
+			_error_pages.erase(std::make_pair(&generation->servers[i], it->first));
 		}
-		fcntl(server_fd, F_SETFL, O_NONBLOCK);
-		std::memset(&addr, 0, sizeof(addr));
-		addr.sin_family = AF_INET;
-		if (_servers[i]._host == "0.0.0.0" || _servers[i]._host.empty())
+		for (size_t j = 0; j < generation->servers[i]._locations.size(); j++)
 		{
-			addr.sin_addr.s_addr = INADDR_ANY;
+			_cgi_running.erase(&generation->servers[i]._locations[j]);
+			_cgi_queues.erase(&generation->servers[i]._locations[j]);
 		}
-		else if (_servers[i]._host == "localhost" || _servers[i]._host == "127.0.0.1")
+	}
+	delete generation;
+}
+
+void WebServer::eraseClient(std::map<int, ClientConnection>::iterator it)
+{
+	Generation *generation = it->second.generation;
+
+	g_clients.erase(it);
+	if (!generation || --generation->connections > 0 || generation == _generation)
+	{
+		return;
+	}
+	_retired.erase(std::remove(_retired.begin(), _retired.end(), generation), _retired.end());
+	destroyGeneration(generation);
+}
+
+void WebServer::addVirtualHost(VirtualHosts &vhosts, const ServerConfig &server)
+{
+	if (!vhosts.default_server || (server._default_server && !vhosts.default_server->_default_server))
+	{
+		vhosts.default_server = &server;
+	}
+	for (size_t i = 0; i < server._server_names.size(); i++)
+	{
+		std::string name = normalizeHost(server._server_names[i]);
+		if (name.compare(0, 2, "*.") == 0)
 		{
-			addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+			vhosts.wildcards.insert(std::make_pair(name.substr(1), &server));
 		}
 		else
 		{
-			if (inet_pton(AF_INET, _servers[i]._host.c_str(),
-						  &addr.sin_addr) <= 0)
-			{
-				std::cerr << "Invalid address: " << _servers[i]._host << std::endl;
-				close(server_fd);
-				continue;
-			}
-		}
-		addr.sin_port = htons(_servers[i]._port);
-		if (bind(server_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
-		{
-			perror("bind");
-			close(server_fd);
-			continue;
-		}
-		if (listen(server_fd, 128) < 0)
-		{
-			perror("listen");
-			close(server_fd);
-			continue;
-		}
-		pfd.fd = server_fd;
-		pfd.events = POLLIN;
-		_poll_fds.push_back(pfd);
-		_server_fds.push_back(server_fd);
-		used_addresses[addr_key.str()] = server_fd;
-		std::cout << "✓ Listening on " << _servers[i]._host << ":" << _servers[i]._port;
-		if (!_servers[i]._server_names.empty())
-		{
-			std::cout << " (";
-			for (size_t j = 0; j < _servers[i]._server_names.size(); j++)
-			{
-				if (j > 0)
-					std::cout << ", ";
-				std::cout << _servers[i]._server_names[j];
-			}
-			std::cout << ")";
+			vhosts.names.insert(std::make_pair(name, &server));
 		}
-		std::cout << std::endl;
-	}
-	if (_server_fds.empty())
-	{
-		throw std::runtime_error("Failed to bind any server socket");
 	}
 }
 
 void WebServer::run()
 {
-	setupSockets();
+	struct sigaction action;
+	struct pollfd signal_pfd;
+
+	_listeners.clear();
+	inheritListeners();
+	if (setupSockets(*_generation).empty())
+	{
+		throw std::runtime_error("Failed to bind any server socket");
+	}
+	for (std::map<std::string, int>::iterator it = _inherited.begin(); it != _inherited.end(); ++it)
+	{
+		close(it->second);
+	}
+	_inherited.clear();
+	if (pipe2(g_signal_pipe, O_NONBLOCK | O_CLOEXEC) == 0)
+	{
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = notifyChild;
+		action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGCHLD, &action, NULL);
+		action.sa_flags = SA_RESTART;
+		action.sa_handler = requestReload;
+		sigaction(SIGHUP, &action, NULL);
+		action.sa_handler = requestShutdown;
+		sigaction(SIGINT, &action, NULL);
+		sigaction(SIGTERM, &action, NULL);
+		action.sa_handler = requestUpgrade;
+		sigaction(SIGUSR2, &action, NULL);
+		signal_pfd.fd = g_signal_pipe[0];
+		signal_pfd.events = POLLIN;
+		signal_pfd.revents = 0;
+		_poll_fds.push_back(signal_pfd);
+	}
+	if (_missing.open())
+	{
+		struct pollfd inotify_pfd;
+		inotify_pfd.fd = _missing.getFd();
+		inotify_pfd.events = POLLIN;
+		inotify_pfd.revents = 0;
+		_poll_fds.push_back(inotify_pfd);
+	}
+	prepareLocations(*_generation);
 	std::cout << "\n🚀 Webserv started successfully!\n"
 			  << std::endl;
+	const char *parent = getenv("WEBSERV_PARENT");
+	if (parent)
+	{
+		pid_t parent_pid = atoi(parent);
+		unsetenv("WEBSERV_PARENT");
+		if (parent_pid > 1 && getppid() == parent_pid)
+		{
+			kill(parent_pid, SIGTERM);
+		}
+	}
 	mainLoop();
+	while (!g_clients.empty())
+	{
+		removeClient(g_clients.begin()->first);
+	}
 }
 
 void WebServer::mainLoop()
 {
 	int activity;
 
-	while (true)
+	while (!_draining || (!g_clients.empty() && time(NULL) < _drain_deadline))
 	{
+		if (g_shutdown)
+		{
+			g_shutdown = 0;
+			shutdown();
+		}
+		if (g_upgrade)
+		{
+			g_upgrade = 0;
+			upgrade();
+		}
+		if (g_reload && !_draining)
+		{
+			g_reload = 0;
+			reload();
+		}
+		if (_draining)
+		{
+			drain();
+		}
 		checkTimeouts();
+		syncFastCGI();
+		resumePendingCGI();
 		activity = poll(_poll_fds.data(), _poll_fds.size(), 1000);
 		if (activity < 0)
 		{
@@ -137,27 +938,54 @@ void WebServer::mainLoop()
 			}
 			continue;
 		}
-		for (size_t i = 0; i < _poll_fds.size(); i++)
+		std::vector<struct pollfd> ready(_poll_fds);
+		for (size_t i = 0; i < ready.size(); i++)
 		{
-			if (_poll_fds[i].revents & POLLIN)
+			if (ready[i].revents == 0)
 			{
-				if (std::find(_server_fds.begin(), _server_fds.end(),
-							  _poll_fds[i].fd) != _server_fds.end())
-				{
-					acceptNewConnection(_poll_fds[i].fd);
-				}
-				else
-				{
-					handleClientData(_poll_fds[i].fd);
-				}
+				continue;
 			}
-			else if (_poll_fds[i].revents & (POLLHUP | POLLERR | POLLNVAL))
+			if (std::find(_server_fds.begin(), _server_fds.end(),
+						  ready[i].fd) != _server_fds.end())
 			{
-				if (std::find(_server_fds.begin(), _server_fds.end(),
-							  _poll_fds[i].fd) == _server_fds.end())
+				if (ready[i].revents & POLLIN)
 				{
-					removeClient(_poll_fds[i].fd);
+					acceptNewConnection(ready[i].fd);
 				}
+				continue;
+			}
+			if (ready[i].fd == g_signal_pipe[0])
+			{
+				reapChildren();
+				continue;
+			}
+			if (ready[i].fd == _missing.getFd())
+			{
+				_missing.handleEvents();
+				continue;
+			}
+			if (_cgi_fds.count(ready[i].fd))
+			{
+				handleCGIEvent(ready[i].fd);
+				continue;
+			}
+			if (_fastcgi_fds.count(ready[i].fd))
+			{
+				_fastcgi.handleEvent(ready[i].fd, ready[i].revents);
+				continue;
+			}
+			if (ready[i].revents & POLLIN)
+			{
+				handleClientData(ready[i].fd);
+			}
+			else if (ready[i].revents & (POLLHUP | POLLERR | POLLNVAL))
+			{
+				removeClient(ready[i].fd);
+				continue;
+			}
+			if (ready[i].revents & POLLOUT)
+			{
+				handleClientWrite(ready[i].fd);
 			}
 		}
 	}
@@ -165,18 +993,16 @@ void WebServer::mainLoop()
 
 void WebServer::acceptNewConnection(int server_fd)
 {
-	sockaddr_in client_addr;
+	struct sockaddr_storage client_addr;
 	socklen_t client_len;
 	int client_fd;
 	struct pollfd client_pfd;
 	ClientConnection conn;
-	char client_ip[INET_ADDRSTRLEN];
-	sockaddr_in local_addr;
-	socklen_t local_len;
-	int local_port;
+	char client_ip[INET6_ADDRSTRLEN] = "unix:";
 
 	client_len = sizeof(client_addr);
-	client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_len);
+	client_fd = accept4(server_fd, (struct sockaddr *)&client_addr, &client_len,
+						SOCK_NONBLOCK | SOCK_CLOEXEC);
 	if (client_fd < 0)
 	{
 		if (errno != EAGAIN && errno != EWOULDBLOCK)
@@ -185,37 +1011,31 @@ void WebServer::acceptNewConnection(int server_fd)
 		}
 		return;
 	}
-	fcntl(client_fd, F_SETFL, O_NONBLOCK);
 	client_pfd.fd = client_fd;
 	client_pfd.events = POLLIN;
 	_poll_fds.push_back(client_pfd);
-	conn.fd = client_fd;
-	conn.buffer = "";
-	conn.last_activity = time(NULL);
-	conn.keep_alive = false;
-	inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
-	conn.client_ip = client_ip;
-	conn.server = &_servers[0];
-	local_len = sizeof(local_addr);
-	if (getsockname(server_fd, (struct sockaddr *)&local_addr, &local_len) == 0)
+	initConnection(conn, client_fd);
+	if (client_addr.ss_family == AF_INET)
 	{
-		local_port = ntohs(local_addr.sin_port);
-		for (size_t i = 0; i < _servers.size(); i++)
-		{
-			if (_servers[i]._port == local_port)
-			{
-				conn.server = &_servers[i];
-				break;
-			}
-		}
+		inet_ntop(AF_INET, &reinterpret_cast<struct sockaddr_in *>(&client_addr)->sin_addr,
+				  client_ip, sizeof(client_ip));
+	}
+	else if (client_addr.ss_family == AF_INET6)
+	{
+		inet_ntop(AF_INET6, &reinterpret_cast<struct sockaddr_in6 *>(&client_addr)->sin6_addr,
+				  client_ip, sizeof(client_ip));
 	}
+	conn.client_ip = client_ip;
+	conn.vhosts = &_generation->virtual_hosts[server_fd];
+	conn.server = conn.vhosts->default_server;
+	conn.generation = _generation;
+	_generation->connections++;
 	g_clients[client_fd] = conn;
 	std::cout << "✓ New client connected: " << client_ip << " (fd: " << client_fd << ")" << std::endl;
 }
 
 void WebServer::handleClientData(int client_fd)
 {
-	char buffer[BUFFER_SIZE];
 	ssize_t bytes;
 
 	std::map<int, ClientConnection>::iterator it = g_clients.find(client_fd);
@@ -225,7 +1045,13 @@ void WebServer::handleClientData(int client_fd)
 	}
 	ClientConnection &conn = it->second;
 	conn.last_activity = time(NULL);
-	bytes = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
+	size_t size = conn.server ? conn.server->_recv_buffer_size : BUFFER_SIZE;
+	if (_recv_buffer.size() < size)
+	{
+		_recv_buffer.resize(size);
+	}
+	char *buffer = &_recv_buffer[0];
+	bytes = recv(client_fd, buffer, size - 1, 0);
 	if (bytes <= 0)
 	{
 		if (bytes == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
@@ -235,21 +1061,231 @@ void WebServer::handleClientData(int client_fd)
 		}
 		return;
 	}
-	buffer[bytes] = '\0';
-	conn.buffer.append(buffer, bytes);
-	if (isCompleteRequest(conn.buffer))
+	if (conn.spool_fd >= 0)
+	{
+		writeSpool(conn, buffer, bytes);
+	}
+	else
+	{
+		buffer[bytes] = '\0';
+		conn.buffer.append(buffer, bytes);
+	}
+	processBuffer(conn);
+}
+
+void WebServer::processBuffer(ClientConnection &conn)
+{
+	int client_fd = conn.fd;
+
+	if (conn.source || conn.out_offset < conn.out.size() || conn.close_after_write ||
+		conn.cgi || conn.cgi_queued || !conn.cache_key.empty())
+	{
+		return;
+	}
+	if (conn.spool_fd < 0 && !spoolBody(conn))
+	{
+		return;
+	}
+	if (conn.spool_fd >= 0 ? conn.spool_remaining == 0 : isCompleteRequest(conn.buffer))
 	{
 		processRequest(conn);
 		conn.buffer.clear();
+		conn.buffer.swap(conn.pipelined);
+		closeSpool(conn);
 		if (!conn.keep_alive)
 		{
-			removeClient(client_fd);
+			conn.close_after_write = true;
 		}
+		handleClientWrite(client_fd);
 	}
-	else if (conn.buffer.size() > 1024 * 1024)
+	else if (conn.buffer.size() > (conn.server ? conn.server->_client_header_buffer_size : 1024 * 1024))
 	{
 		sendErrorResponse(client_fd, 413, "Payload Too Large", conn.server);
+		conn.close_after_write = true;
+		handleClientWrite(client_fd);
+	}
+}
+
+bool WebServer::spoolBody(ClientConnection &conn)
+{
+	size_t body_start = conn.buffer.find("\r\n\r\n");
+	char path[] = "/tmp/webserv_body_XXXXXX";
+
+	if (body_start == std::string::npos)
+	{
+		return (true);
+	}
+	body_start += 4;
+	size_t length = std::strtoul(getHeaderValue(conn.buffer.substr(0, body_start),
+												"content-length").c_str(), NULL, 10);
+	if (length <= SPOOL_THRESHOLD)
+	{
+		return (true);
+	}
+	if (length > conn.server->_client_max_body_size)
+	{
+		sendErrorResponse(conn.fd, 413, "Payload Too Large", conn.server);
+		conn.close_after_write = true;
+		handleClientWrite(conn.fd);
+		return (false);
+	}
+	conn.spool_fd = mkostemp(path, O_CLOEXEC);
+	if (conn.spool_fd < 0)
+	{
+		perror("mkostemp");
+		return (true);
+	}
+	unlink(path);
+	conn.spool_size = length;
+	conn.spool_remaining = length;
+	std::string body = conn.buffer.substr(body_start);
+	conn.buffer.erase(body_start);
+	writeSpool(conn, body.data(), body.size());
+	if (conn.spool_remaining > 0 &&
+		toLowerCase(getHeaderValue(conn.buffer, "expect")) == "100-continue")
+	{
+		conn.out += "HTTP/1.1 100 Continue\r\n\r\n";
+		handleClientWrite(conn.fd);
+	}
+	return (true);
+}
+
+void WebServer::writeSpool(ClientConnection &conn, const char *data, size_t len)
+{
+	ssize_t written;
+
+	if (len > conn.spool_remaining)
+	{
+		conn.pipelined.append(data + conn.spool_remaining, len - conn.spool_remaining);
+		len = conn.spool_remaining;
+	}
+	while (len > 0)
+	{
+		written = write(conn.spool_fd, data, len);
+		if (written <= 0)
+		{
+			perror("spool write");
+			closeSpool(conn);
+			sendErrorResponse(conn.fd, 500, "Internal Server Error", conn.server);
+			conn.close_after_write = true;
+			handleClientWrite(conn.fd);
+			return;
+		}
+		data += written;
+		len -= written;
+		conn.spool_remaining -= written;
+	}
+}
+
+void WebServer::closeSpool(ClientConnection &conn)
+{
+	if (conn.spool_fd >= 0)
+	{
+		close(conn.spool_fd);
+	}
+	conn.spool_fd = -1;
+	conn.spool_size = 0;
+	conn.spool_remaining = 0;
+}
+
+void WebServer::handleClientWrite(int client_fd)
+{
+	ssize_t sent;
+
+	std::map<int, ClientConnection>::iterator it = g_clients.find(client_fd);
+	if (it == g_clients.end())
+	{
+		return;
+	}
+	ClientConnection &conn = it->second;
+	while (true)
+	{
+		pumpBody(conn);
+		if (conn.out_offset >= conn.out.size())
+		{
+			break;
+		}
+		int flags = (conn.vhosts && conn.vhosts->tcp_nopush && dynamic_cast<FileSource *>(conn.source))
+						? MSG_MORE
+						: 0;
+		sent = send(client_fd, conn.out.data() + conn.out_offset,
+					conn.out.size() - conn.out_offset, flags);
+		if (sent < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				updatePollEvents(client_fd, POLLIN | POLLOUT);
+				throttleCGI(conn);
+				return;
+			}
+			std::cerr << "Error sending response to client " << client_fd << ": "
+					  << strerror(errno) << std::endl;
+			removeClient(client_fd);
+			return;
+		}
+		conn.out_offset += sent;
+		conn.last_activity = time(NULL);
+		if (conn.out_offset == conn.out.size())
+		{
+			conn.out.clear();
+			conn.out_offset = 0;
+		}
+		else if (conn.out_offset > SOURCE_CHUNK)
+		{
+			conn.out.erase(0, conn.out_offset);
+			conn.out_offset = 0;
+		}
+	}
+	updatePollEvents(client_fd, POLLIN);
+	if (conn.cgi || conn.cgi_queued || !conn.cache_key.empty())
+	{
+		throttleCGI(conn);
+		return;
+	}
+	if (conn.close_after_write)
+	{
 		removeClient(client_fd);
+		return;
+	}
+	if (!conn.buffer.empty())
+	{
+		processBuffer(conn);
+	}
+}
+
+void WebServer::pumpBody(ClientConnection &conn)
+{
+	while (conn.source && conn.out.size() - conn.out_offset < OUTPUT_HIGH_WATER)
+	{
+		std::string chunk;
+		bool more = conn.source->produce(chunk, SOURCE_CHUNK);
+		if (chunk.empty() && more)
+		{
+			break;
+		}
+		encodeBody(conn.encoders, 0, chunk, conn.out);
+		if (!more)
+		{
+			for (size_t i = 0; i < conn.encoders.size(); i++)
+			{
+				std::string tail;
+				conn.encoders[i]->finish(tail);
+				encodeBody(conn.encoders, i + 1, tail, conn.out);
+			}
+			releaseBody(conn);
+		}
+	}
+}
+
+void WebServer::updatePollEvents(int fd, short events)
+{
+	for (size_t i = 0; i < _poll_fds.size(); i++)
+	{
+		if (_poll_fds[i].fd == fd)
+		{
+			_poll_fds[i].events = events;
+			return;
+		}
 	}
 }
 
@@ -326,6 +1362,10 @@ void WebServer::processRequest(ClientConnection &conn)
 		sendErrorResponse(conn.fd, 400, "Bad Request", conn.server);
 		return;
 	}
+	if (conn.spool_fd >= 0)
+	{
+		request.setBodyFile(conn.spool_fd, conn.spool_size);
+	}
 
 	std::string cookie_header = request.getHeader("cookie");
 	bool has_session_cookie = false;
@@ -358,33 +1398,12 @@ void WebServer::processRequest(ClientConnection &conn)
 	conn.needs_cookie = !has_session_cookie;
 
 	if (conn.needs_cookie)
-	{
-		std::cout << "🆕 Client " << conn.client_ip << " needs new session cookie" << std::endl;
-	}
-
-	std::string host = request.getHeader("host");
-	if (!host.empty())
-	{
-		size_t colon = host.find(':');
-		if (colon != std::string::npos)
-		{
-			host = host.substr(0, colon);
-		}
-
-		for (size_t i = 0; i < _servers.size(); i++)
-		{
-			for (size_t j = 0; j < _servers[i]._server_names.size(); j++)
-			{
-				if (_servers[i]._server_names[j] == host &&
-					_servers[i]._port == conn.server->_port)
-				{
-					conn.server = &_servers[i];
-					break;
-				}
-			}
-		}
+	{
+		std::cout << "🆕 Client " << conn.client_ip << " needs new session cookie" << std::endl;
 	}
 
+	conn.server = findVirtualHost(*conn.vhosts, normalizeHost(request.getHeader("host")));
+
 	std::cout << "📥 " << request.getMethod() << " " << request.getUri()
 			  << " from " << conn.client_ip << " (fd:" << conn.fd << ")"
 			  << " [Server: " << (conn.server->_server_names.empty() ? "default" : conn.server->_server_names[0]) << "]";
@@ -402,32 +1421,23 @@ void WebServer::processRequest(ClientConnection &conn)
 	const LocationConfig &location = conn.server->findLocationForRequest(request.getUri());
 
 	size_t max_body_size = conn.server->_client_max_body_size;
-	if (request.getBody().size() > max_body_size)
+	if (request.getBodySize() > max_body_size)
 	{
 		sendErrorResponse(conn.fd, 413, "Payload Too Large", conn.server);
 		return;
 	}
 
-	if (!location._allowed_methods.empty())
+	if (!location.allows(request.getMethod()))
 	{
-		bool method_allowed = false;
-		for (size_t i = 0; i < location._allowed_methods.size(); i++)
-		{
-			if (location._allowed_methods[i] == request.getMethod())
-			{
-				method_allowed = true;
-				break;
-			}
-		}
-
-		if (!method_allowed)
-		{
-			sendErrorResponse(conn.fd, 405, "Method Not Allowed", conn.server);
-			return;
-		}
+		sendErrorResponse(conn.fd, 405, "Method Not Allowed", conn.server);
+		return;
 	}
 
-	if (request.getMethod() == "GET" || request.getMethod() == "HEAD")
+	if (!location._handler_module.empty())
+	{
+		handleModuleRequest(conn, request, location);
+	}
+	else if (request.getMethod() == "GET" || request.getMethod() == "HEAD")
 	{
 		handleGetRequest(conn, request, location);
 	}
@@ -470,44 +1480,110 @@ std::string WebServer::generateSessionId()
 	return session_id;
 }
 
-void WebServer::sendResponse(int client_fd, const HttpResponse &response)
+void WebServer::addSessionCookie(ClientConnection &conn, std::string &head)
 {
-	std::string data = response.serialize();
-	std::map<int, ClientConnection>::iterator it = g_clients.find(client_fd);
+	if (!conn.needs_cookie)
+	{
+		return;
+	}
+	std::ostringstream session_id;
+	srand(time(NULL) + conn.fd + rand());
 
-	if (it != g_clients.end() && it->second.needs_cookie)
+	for (int i = 0; i < 32; i++)
 	{
+		session_id << std::hex << (rand() % 16);
+	}
 
-		size_t header_end = data.find("\r\n\r\n");
-		if (header_end != std::string::npos)
-		{
+	insertHeader(head, "Set-Cookie", "WEBSERV_SESSION=" + session_id.str() +
+										  "; Path=/; Max-Age=3600; HttpOnly");
 
-			std::ostringstream session_id;
-			srand(time(NULL) + client_fd + rand());
+	std::cout << "🍪 Set new session cookie for client " << conn.client_ip
+			  << " (fd:" << conn.fd << "): " << session_id.str() << std::endl;
 
-			for (int i = 0; i < 32; i++)
-			{
-				session_id << std::hex << (rand() % 16);
-			}
+	conn.needs_cookie = false;
+}
 
-			std::string cookie = "Set-Cookie: WEBSERV_SESSION=" + session_id.str() +
-								 "; Path=/; Max-Age=3600; HttpOnly\r\n";
+void WebServer::sendResponse(int client_fd, const HttpResponse &response)
+{
+	queueData(client_fd, response.serialize());
+}
 
-			data.insert(header_end, cookie);
+void WebServer::queueData(int client_fd, const std::string &data)
+{
+	std::map<int, ClientConnection>::iterator it = g_clients.find(client_fd);
 
-			std::cout << "🍪 Set new session cookie for client " << it->second.client_ip
-					  << " (fd:" << client_fd << "): " << session_id.str() << std::endl;
+	if (it == g_clients.end())
+	{
+		if (send(client_fd, data.c_str(), data.length(), 0) < 0)
+		{
+			std::cerr << "Error sending response to client " << client_fd << ": "
+					  << strerror(errno) << std::endl;
+		}
+		return;
+	}
+	if (it->second.needs_cookie)
+	{
+		std::string head = data;
+		addSessionCookie(it->second, head);
+		it->second.out += head;
+		return;
+	}
+	it->second.out += data;
+}
 
-			it->second.needs_cookie = false;
+void WebServer::queueStream(ClientConnection &conn, std::string head, BodySource *body,
+							const std::string &encoding, bool chunked, BodyEncoder *cache_fill)
+{
+	if (!encoding.empty())
+	{
+		removeHeader(head, "content-length");
+		insertHeader(head, "content-encoding", encoding);
+	}
+	if (!encoding.empty() && body)
+	{
+		conn.encoders.push_back(new DeflateEncoder(encoding == "gzip" ? Deflater::GZIP : Deflater::ZLIB));
+		if (cache_fill)
+		{
+			conn.encoders.push_back(cache_fill);
 		}
 	}
+	else
+	{
+		delete cache_fill;
+	}
+	if (chunked)
+	{
+		insertHeader(head, "transfer-encoding", "chunked");
+	}
+	if (chunked && body)
+	{
+		conn.encoders.push_back(new ChunkedEncoder());
+	}
+	addSessionCookie(conn, head);
+	conn.out += head;
+	conn.source = body;
+}
 
-	ssize_t sent = send(client_fd, data.c_str(), data.length(), 0);
-	if (sent < 0)
+bool WebServer::isCompressible(const HttpRequest &request, const LocationConfig &location,
+							   const std::string &content_type, long length) const
+{
+	if (!location._gzip || request.getHttpVersion() != "HTTP/1.1")
 	{
-		std::cerr << "Error sending response to client " << client_fd << ": "
-				  << strerror(errno) << std::endl;
+		return (false);
+	}
+	if (length >= 0 && static_cast<size_t>(length) < location._gzip_min_length)
+	{
+		return (false);
+	}
+	std::string type = toLowerCase(trim(content_type.substr(0, content_type.find(';'))));
+	for (size_t i = 0; i < location._gzip_types.size(); i++)
+	{
+		if (location._gzip_types[i] == "*" || location._gzip_types[i] == type)
+		{
+			return (true);
+		}
 	}
+	return (false);
 }
 
 void WebServer::handleGetRequest(ClientConnection &conn,
@@ -521,76 +1597,92 @@ void WebServer::handleGetRequest(ClientConnection &conn,
 		sendRedirectResponse(conn.fd, 301, location._redirect);
 		return;
 	}
-	std::string file_path = location._root;
-	if (file_path.empty())
+	if (location._metrics)
 	{
-		file_path = "./www";
+		response.setStatusCode(200);
+		response.addHeader("content-type", "text/plain; version=0.0.4");
+		response.setBody(Metrics::render());
+		sendResponse(conn.fd, response);
+		return;
 	}
+	std::string file_path;
 	std::string uri = request.getUri();
+	std::string query;
 	query_pos = uri.find('?');
 	if (query_pos != std::string::npos)
 	{
+		query = uri.substr(query_pos + 1);
 		uri = uri.substr(0, query_pos);
 	}
-	uri = urlDecode(uri);
-	if (uri.find("../") != std::string::npos)
+	std::string original_uri = urlDecode(uri);
+	if (!location.resolvePath(original_uri, file_path))
 	{
 		sendErrorResponse(conn.fd, 403, "Forbidden", conn.server);
 		return;
 	}
-	std::string original_uri = uri;
-	if (location._path != "/" && uri.find(location._path) == 0)
+	if (!location._cgi_extension.empty() && file_path.find(location._cgi_extension) != std::string::npos)
 	{
-		if (uri == location._path)
-		{
-			uri = "/";
-		}
-		else if (uri.length() > location._path.length() && uri[location._path.length()] == '/')
-		{
-			uri = uri.substr(location._path.length());
-		}
+		handleCGIRequest(conn, request, location, file_path);
+		return;
 	}
-	if (location._path == "/uploads")
+	if (_missing.contains(file_path, time(NULL)))
 	{
-		file_path = "www/uploads";
-		if (uri != "/")
-		{
-			file_path += uri;
-		}
+		Metrics::increment("webserv_negative_cache_hits_total");
+		sendErrorResponse(conn.fd, 404, "Not Found", conn.server);
+		return;
 	}
-	else if (location._path == "/cgi-bin")
+	struct stat info;
+	int fd = openResolved(location, file_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
 	{
-		file_path = "www/cgi-bin";
-		if (uri != "/")
+		if (errno == ENOENT || errno == ENOTDIR)
 		{
-			file_path += uri;
+			_missing.insert(file_path, time(NULL));
+			sendErrorResponse(conn.fd, 404, "Not Found", conn.server);
+		}
+		else
+		{
+			sendErrorResponse(conn.fd, 403, "Forbidden", conn.server);
 		}
-	}
-	else
-	{
-		file_path += uri;
-	}
-	if (!location._cgi_extension.empty() && file_path.find(location._cgi_extension) != std::string::npos)
-	{
-		handleCGIRequest(conn, request, location, file_path);
 		return;
 	}
-	if (!fileExists(file_path))
+	if (fstat(fd, &info) != 0)
 	{
-		sendErrorResponse(conn.fd, 404, "Not Found", conn.server);
+		close(fd);
+		sendErrorResponse(conn.fd, 500, "Internal Server Error", conn.server);
 		return;
 	}
-	if (isDirectory(file_path))
+	if (S_ISDIR(info.st_mode))
 	{
 		if (file_path[file_path.length() - 1] != '/')
 		{
+			close(fd);
 			sendRedirectResponse(conn.fd, 301, original_uri + "/");
 			return;
 		}
-		std::string index_path = file_path + location._index_file;
-		if (!location._index_file.empty() && fileExists(index_path))
+		int index_fd = -1;
+		if (!location._index_file.empty())
+		{
+			index_fd = openBeneath(fd, location._index_file.c_str(), O_RDONLY | O_CLOEXEC);
+			if (index_fd < 0 && errno != ENOENT)
+			{
+				close(fd);
+				sendErrorResponse(conn.fd, 403, "Forbidden", conn.server);
+				return;
+			}
+		}
+		int dir_fd = fd;
+		fd = index_fd;
+		if (fd >= 0)
 		{
-			file_path = index_path;
+			close(dir_fd);
+			file_path += location._index_file;
+			if (fstat(fd, &info) != 0)
+			{
+				close(fd);
+				sendErrorResponse(conn.fd, 500, "Internal Server Error", conn.server);
+				return;
+			}
 		}
 		else if (location._directory_listing)
 		{
@@ -599,31 +1691,59 @@ void WebServer::handleGetRequest(ClientConnection &conn,
 			{
 				listing_uri += "/";
 			}
-			std::string listing = generateDirectoryListing(file_path,
-														   listing_uri);
-			if (listing.empty())
+			DirectorySnapshot *snapshot = _directories.acquire(file_path, dir_fd, info);
+			close(dir_fd);
+			if (!snapshot)
 			{
 				sendErrorResponse(conn.fd, 403, "Forbidden", conn.server);
 				return;
 			}
+			std::string encoding;
+			bool chunked = request.getHttpVersion() == "HTTP/1.1";
+			bool json = location._autoindex_format == "json" ||
+						request.getHeader("accept").find("application/json") != std::string::npos;
+			std::string content_type = json ? "application/json" : "text/html";
+			std::string vary = location._autoindex_format == "json" ? "" : "Accept";
 			response.setStatusCode(200);
-			response.setBody(listing);
-			response.addHeader("content-type", "text/html");
-			sendResponse(conn.fd, response);
+			response.addHeader("content-type", content_type);
+			if (isCompressible(request, location, content_type, -1))
+			{
+				vary += vary.empty() ? "Accept-Encoding" : ", Accept-Encoding";
+				encoding = negotiateEncoding(request);
+			}
+			if (!vary.empty())
+			{
+				response.addHeader("vary", vary);
+			}
+			if (request.getMethod() == "HEAD")
+			{
+				snapshot->release();
+				queueStream(conn, response.serialize(), NULL, encoding, chunked);
+				return;
+			}
+			if (!chunked)
+			{
+				conn.keep_alive = false;
+			}
+			queueStream(conn, response.serialize(),
+						new DirectoryListingSource(snapshot, parseListingOptions(listing_uri, query, json)),
+						encoding, chunked);
 			return;
 		}
 		else
 		{
+			close(dir_fd);
 			sendErrorResponse(conn.fd, 403, "Forbidden", conn.server);
 			return;
 		}
 	}
-	if (!isReadable(file_path))
+	if (!S_ISREG(info.st_mode))
 	{
+		close(fd);
 		sendErrorResponse(conn.fd, 403, "Forbidden", conn.server);
 		return;
 	}
-	serveStaticFile(conn.fd, file_path, request.getMethod() == "HEAD");
+	serveStaticFile(conn, fd, info, file_path, request, location);
 }
 
 void WebServer::handlePostRequest(ClientConnection &conn,
@@ -632,215 +1752,663 @@ void WebServer::handlePostRequest(ClientConnection &conn,
 	size_t query_pos;
 
 	std::string uri = request.getUri();
+	std::string file_path;
 	query_pos = uri.find('?');
 	if (query_pos != std::string::npos)
 	{
-		uri = uri.substr(0, query_pos);
+		uri = uri.substr(0, query_pos);
+	}
+	if (!location._cgi_extension.empty() && location.resolvePath(urlDecode(uri), file_path) &&
+		file_path.find(location._cgi_extension) != std::string::npos)
+	{
+		handleCGIRequest(conn, request, location, file_path);
+		return;
+	}
+	if (!location._upload_path.empty())
+	{
+		handleFileUpload(conn, request, location);
+		return;
+	}
+	sendErrorResponse(conn.fd, 405, "Method Not Allowed", conn.server);
+}
+
+void WebServer::handlePutRequest(ClientConnection &conn,
+								 const HttpRequest &request, const LocationConfig &location)
+{
+	bool file_existed;
+	HttpResponse response;
+
+	std::string file_path;
+	if (!location.resolvePath(urlDecode(request.getUri()), file_path))
+	{
+		sendErrorResponse(conn.fd, 403, "Forbidden", conn.server);
+		return;
+	}
+	std::string dir_path = file_path.substr(0, file_path.find_last_of('/'));
+	if (!fileExists(dir_path))
+	{
+		sendErrorResponse(conn.fd, 404, "Not Found", conn.server);
+		return;
+	}
+	file_existed = fileExists(file_path);
+	if (writeFile(file_path, request.getBody()))
+	{
+		response.setStatusCode(file_existed ? 204 : 201);
+		if (!file_existed)
+		{
+			response.addHeader("location", request.getUri());
+		}
+		sendResponse(conn.fd, response);
+		std::cout << "📝 PUT file: " << file_path << " (" << (file_existed ? "updated" : "created") << ")" << std::endl;
+	}
+	else
+	{
+		sendErrorResponse(conn.fd, 500, "Internal Server Error", conn.server);
+	}
+}
+
+void WebServer::handleDeleteRequest(ClientConnection &conn,
+									const HttpRequest &request, const LocationConfig &location)
+{
+	HttpResponse response;
+
+	std::string file_path;
+	if (!location.resolvePath(urlDecode(request.getUri()), file_path))
+	{
+		sendErrorResponse(conn.fd, 403, "Forbidden", conn.server);
+		return;
+	}
+	struct stat info;
+	int dir_fd = location._root_fd >= 0 ? location._root_fd : AT_FDCWD;
+	const char *target = location._root_fd >= 0 ? relativePath(location, file_path) : file_path.c_str();
+	if (fstatat(dir_fd, target, &info, AT_SYMLINK_NOFOLLOW) != 0)
+	{
+		sendErrorResponse(conn.fd, 404, "Not Found", conn.server);
+		return;
+	}
+	if (S_ISDIR(info.st_mode) || faccessat(dir_fd, target, W_OK, AT_SYMLINK_NOFOLLOW) != 0)
+	{
+		sendErrorResponse(conn.fd, 403, "Forbidden", conn.server);
+		return;
+	}
+	if (unlinkat(dir_fd, target, 0) == 0)
+	{
+		response.setStatusCode(204);
+		sendResponse(conn.fd, response);
+		std::cout << "🗑️  Deleted: " << file_path << std::endl;
+	}
+	else
+	{
+		sendErrorResponse(conn.fd, 500, "Internal Server Error", conn.server);
+	}
+}
+
+void WebServer::handleModuleRequest(ClientConnection &conn, const HttpRequest &request,
+									const LocationConfig &location)
+{
+	HandlerModule *module = _modules[location._handler_module];
+	HttpResponse response;
+	StreamSource *body = new StreamSource();
+	std::string encoding;
+
+	module->refresh(time(NULL));
+	Metrics::increment(Metrics::label("webserv_module_requests_total", "module",
+									  location._handler_module));
+	if (!module->handle(request, conn.client_ip, response, *body))
+	{
+		delete body;
+		std::cerr << "Module Error: " << location._handler_module << " failed" << std::endl;
+		sendErrorResponse(conn.fd, 500, "Internal Server Error", conn.server);
+		return;
+	}
+	body->close();
+	response.addHeader("content-length", toString(body->buffered()));
+	std::string head = response.serialize();
+	if (head.compare(0, 12, "HTTP/1.1 200") == 0 &&
+		isCompressible(request, location, getHeaderValue(head, "content-type"), body->buffered()))
+	{
+		encoding = negotiateEncoding(request);
+		insertHeader(head, "Vary", "Accept-Encoding");
+	}
+	if (request.getMethod() == "HEAD")
+	{
+		delete body;
+		body = NULL;
+	}
+	queueStream(conn, head, body, encoding, !encoding.empty());
+}
+
+void WebServer::handleCGIRequest(ClientConnection &conn,
+								 const HttpRequest &request, const LocationConfig &location,
+								 const std::string &script_path)
+{
+	std::cout << "🔧 Executing CGI: " << script_path << std::endl;
+	if (!fileExists(script_path))
+	{
+		std::cerr << "CGI Error: Script not found: " << script_path << std::endl;
+		sendErrorResponse(conn.fd, 404, "CGI Script Not Found", conn.server);
+		return;
+	}
+	if (location._cgi_cache && conn.cache_key.empty() &&
+		(request.getMethod() == "GET" || request.getMethod() == "HEAD") &&
+		serveCachedCGI(conn, request, location, script_path))
+	{
+		return;
+	}
+	runCGI(conn, request, location, script_path);
+}
+
+void WebServer::runCGI(ClientConnection &conn, const HttpRequest &request,
+					   const LocationConfig &location, const std::string &script_path)
+{
+	if (acquireCGISlot(conn, request, location, script_path))
+	{
+		launchCGI(conn, request, location, script_path);
+		if (!conn.cgi)
+		{
+			releaseCGISlot(location);
+		}
+	}
+	if (!conn.cgi && !conn.cgi_queued && !conn.cache_key.empty())
+	{
+		releaseCacheLock(conn);
+	}
+}
+
+bool WebServer::acquireCGISlot(ClientConnection &conn, const HttpRequest &request,
+							   const LocationConfig &location, const std::string &script_path)
+{
+	if (conn.cgi_queued)
+	{
+		conn.cgi_queued = false;
+		return (true);
+	}
+	size_t &running = _cgi_running[&location];
+	if (location._cgi_max_concurrency == 0 || running < location._cgi_max_concurrency)
+	{
+		running++;
+		return (true);
+	}
+	std::deque<int> &queue = _cgi_queues[&location];
+	if (queue.size() >= location._cgi_queue_size)
+	{
+		HttpResponse response;
+		response.setError(503, "Service Unavailable");
+		response.addHeader("retry-after", "1");
+		Metrics::increment(Metrics::label("webserv_cgi_queue_rejected_total", "location",
+										  location._path));
+		sendResponse(conn.fd, response);
+		return (false);
+	}
+	deferCGI(conn, request, location, script_path);
+	queue.push_back(conn.fd);
+	conn.cgi_queued = true;
+	Metrics::set(Metrics::label("webserv_cgi_queue_depth", "location", location._path),
+				 queue.size());
+	return (false);
+}
+
+void WebServer::releaseCGISlot(const LocationConfig &location)
+{
+	std::deque<int> &queue = _cgi_queues[&location];
+
+	while (!queue.empty())
+	{
+		int fd = queue.front();
+		queue.pop_front();
+		Metrics::set(Metrics::label("webserv_cgi_queue_depth", "location", location._path),
+					 queue.size());
+		std::map<int, PendingCGI>::iterator pending = _pending_cgi.find(fd);
+		if (pending == _pending_cgi.end())
+		{
+			continue;
+		}
+		Metrics::increment(Metrics::label("webserv_cgi_queue_wait_milliseconds_sum", "location",
+										  location._path),
+						   currentMillis() - pending->second.queued_at);
+		Metrics::increment(Metrics::label("webserv_cgi_queue_wait_milliseconds_count", "location",
+										  location._path));
+		_cgi_retry.push_back(fd);
+		return;
+	}
+	_cgi_running[&location]--;
+}
+
+void WebServer::launchCGI(ClientConnection &conn, const HttpRequest &request,
+						  const LocationConfig &location, const std::string &script_path)
+{
+	if (!location._fastcgi_pass.empty())
+	{
+		conn.cgi = new CGI(request, location, conn.client_ip);
+		conn.cgi->startRemote(script_path);
+		_fastcgi.submit(location._fastcgi_pass, conn.fd, conn.cgi);
+		return;
+	}
+	if (!fileExists(location._cgi_path))
+	{
+		std::cerr << "CGI Error: Interpreter not found: " << location._cgi_path << std::endl;
+		sendErrorResponse(conn.fd, 500, "CGI Interpreter Not Found",
+						  conn.server);
+		return;
+	}
+	if (!isReadable(script_path))
+	{
+		std::cerr << "CGI Error: Script not readable: " << script_path << std::endl;
+		sendErrorResponse(conn.fd, 403, "CGI Script Not Readable", conn.server);
+		return;
 	}
-	std::string file_path = location._root;
-	if (file_path.empty())
+	if (!location._cgi_pool.empty())
 	{
-		file_path = "./www";
+		conn.cgi = new CGI(request, location, conn.client_ip);
+		conn.cgi->startRemote(script_path);
+		_fastcgi.submit(poolAddress(location), conn.fd, conn.cgi);
+		return;
 	}
-	if (location._path != "/" && uri.find(location._path) == 0)
+	CGI *cgi = new CGI(request, location, conn.client_ip);
+	if (!cgi->start(script_path))
 	{
-		if (uri == location._path)
-		{
-			uri = "/";
-		}
-		else if (uri.length() > location._path.length() && uri[location._path.length()] == '/')
-		{
-			uri = uri.substr(location._path.length());
-		}
+		delete cgi;
+		sendErrorResponse(conn.fd, 500, "CGI Execution Failed", conn.server);
+		return;
 	}
-	if (location._path == "/uploads")
+	conn.cgi = cgi;
+	_cgi_pids[cgi->getPid()] = conn.fd;
+	int fds[2] = {cgi->getInputFd(), cgi->getOutputFd()};
+	for (int i = 0; i < 2; i++)
 	{
-		file_path = "www/uploads";
-		if (uri != "/")
+		if (fds[i] < 0)
 		{
-			file_path += uri;
+			continue;
 		}
+		struct pollfd pfd;
+		pfd.fd = fds[i];
+		pfd.events = (i == 0) ? POLLOUT : POLLIN;
+		pfd.revents = 0;
+		_poll_fds.push_back(pfd);
+		_cgi_fds[fds[i]] = conn.fd;
+	}
+}
+
+bool WebServer::serveCachedCGI(ClientConnection &conn, const HttpRequest &request,
+							   const LocationConfig &location, const std::string &script_path)
+{
+	std::string key = cacheKey(request, location);
+	std::string response;
+	time_t age = 0;
+
+	CGICache::Result result = _cgi_cache.lookup(key, time(NULL), response, age);
+	if (result == CGICache::PASS)
+	{
+		Metrics::increment(Metrics::label("webserv_cgi_cache_requests_total", "result", "pass"));
+		return (false);
 	}
-	else if (location._path == "/cgi-bin")
+	if (result == CGICache::MISS)
 	{
-		file_path = "www/cgi-bin";
-		if (uri != "/")
+		conn.cache_key = key;
+		if (_cgi_cache.lock(key))
 		{
-			file_path += uri;
+			Metrics::increment(Metrics::label("webserv_cgi_cache_requests_total", "result", "miss"));
+			return (false);
 		}
+		Metrics::increment(Metrics::label("webserv_cgi_cache_requests_total", "result", "collapsed"));
+		deferCGI(conn, request, location, script_path);
+		_cgi_cache.wait(key, conn.fd);
+		return (true);
 	}
-	else
+	Metrics::increment(Metrics::label("webserv_cgi_cache_requests_total", "result",
+									  result == CGICache::HIT ? "hit" : "stale"));
+	if (result == CGICache::STALE && _cgi_cache.lock(key))
 	{
-		file_path += uri;
+		revalidateCGI(conn, key, request, location, script_path);
 	}
-	if (!location._cgi_extension.empty() && file_path.find(location._cgi_extension) != std::string::npos)
+	insertHeader(response, "Age", toString(age));
+	deliverCGIResponse(conn, response, request, location);
+	return (true);
+}
+
+void WebServer::revalidateCGI(const ClientConnection &origin, const std::string &key,
+							  const HttpRequest &request, const LocationConfig &location,
+							  const std::string &script_path)
+{
+	ClientConnection conn;
+	int fd = _next_detached_fd;
+
+	_next_detached_fd = (fd > INT_MIN) ? fd - 1 : -1;
+	initConnection(conn, fd);
+	conn.server = origin.server;
+	conn.client_ip = origin.client_ip;
+	conn.cache_key = key;
+	conn.generation = origin.generation;
+	if (conn.generation)
 	{
-		handleCGIRequest(conn, request, location, file_path);
-		return;
+		conn.generation->connections++;
 	}
-	if (!location._upload_path.empty())
+	g_clients[fd] = conn;
+	handleCGIRequest(g_clients[fd], request, location, script_path);
+	std::map<int, ClientConnection>::iterator it = g_clients.find(fd);
+	if (it != g_clients.end() && !it->second.cgi && !it->second.cgi_queued)
 	{
-		handleFileUpload(conn, request, location);
-		return;
+		releaseBody(it->second);
+		eraseClient(it);
 	}
-	sendErrorResponse(conn.fd, 405, "Method Not Allowed", conn.server);
 }
 
-void WebServer::handlePutRequest(ClientConnection &conn,
-								 const HttpRequest &request, const LocationConfig &location)
+void WebServer::releaseCacheLock(ClientConnection &conn)
 {
-	bool file_existed;
-	HttpResponse response;
+	_cgi_cache.unlock(conn.cache_key, _cgi_retry);
+	conn.cache_key.clear();
+}
 
-	std::string file_path = location._root;
-	if (file_path.empty())
+void WebServer::deferCGI(ClientConnection &conn, const HttpRequest &request,
+						 const LocationConfig &location, const std::string &script_path)
+{
+	PendingCGI &pending = _pending_cgi[conn.fd];
+	pending.request = request;
+	pending.location = &location;
+	pending.script_path = script_path;
+	pending.queued_at = currentMillis();
+	if (request.getBodyFd() >= 0)
 	{
-		file_path = "./www";
+		pending.request.setBodyFile(fcntl(request.getBodyFd(), F_DUPFD_CLOEXEC, 0),
+									request.getBodySize());
 	}
-	std::string uri = urlDecode(request.getUri());
-	if (uri.find("../") != std::string::npos)
+}
+
+void WebServer::dropPendingCGI(std::map<int, PendingCGI>::iterator pending)
+{
+	if (pending->second.request.getBodyFd() >= 0)
 	{
-		sendErrorResponse(conn.fd, 403, "Forbidden", conn.server);
-		return;
+		close(pending->second.request.getBodyFd());
 	}
-	if (location._path != "/" && uri.find(location._path) == 0)
+	_pending_cgi.erase(pending);
+}
+
+void WebServer::resumePendingCGI()
+{
+	while (!_cgi_retry.empty())
 	{
-		uri = uri.substr(location._path.length());
-		if (uri.empty() || uri[0] != '/')
+		std::vector<int> retry;
+		retry.swap(_cgi_retry);
+		for (size_t i = 0; i < retry.size(); i++)
 		{
-			uri = "/" + uri;
+			std::map<int, PendingCGI>::iterator pending = _pending_cgi.find(retry[i]);
+			std::map<int, ClientConnection>::iterator it = g_clients.find(retry[i]);
+			if (pending == _pending_cgi.end() || it == g_clients.end())
+			{
+				continue;
+			}
+			PendingCGI waiter = pending->second;
+			_pending_cgi.erase(pending);
+			if (it->second.cgi_queued)
+			{
+				runCGI(it->second, waiter.request, *waiter.location, waiter.script_path);
+			}
+			else
+			{
+				it->second.cache_key.clear();
+				handleCGIRequest(it->second, waiter.request, *waiter.location, waiter.script_path);
+			}
+			if (waiter.request.getBodyFd() >= 0)
+			{
+				close(waiter.request.getBodyFd());
+			}
+			if (retry[i] < 0 && !it->second.cgi && !it->second.cgi_queued)
+			{
+				removeClient(retry[i]);
+				continue;
+			}
+			handleClientWrite(retry[i]);
 		}
 	}
-	file_path += uri;
-	std::string dir_path = file_path.substr(0, file_path.find_last_of('/'));
-	if (!fileExists(dir_path))
+}
+
+void WebServer::handleCGIEvent(int pipe_fd)
+{
+	std::map<int, int>::iterator owner = _cgi_fds.find(pipe_fd);
+	std::map<int, ClientConnection>::iterator it = g_clients.find(owner->second);
+	if (it == g_clients.end() || !it->second.cgi)
 	{
-		sendErrorResponse(conn.fd, 404, "Not Found", conn.server);
+		_cgi_fds.erase(owner);
+		removePollFd(pipe_fd);
 		return;
 	}
-	file_existed = fileExists(file_path);
-	if (writeFile(file_path, request.getBody()))
+	ClientConnection &conn = it->second;
+	CGI *cgi = conn.cgi;
+	bool open;
+	if (pipe_fd == cgi->getInputFd())
 	{
-		response.setStatusCode(file_existed ? 204 : 201);
-		if (!file_existed)
-		{
-			response.addHeader("location", request.getUri());
-		}
-		sendResponse(conn.fd, response);
-		std::cout << "📝 PUT file: " << file_path << " (" << (file_existed ? "updated" : "created") << ")" << std::endl;
+		open = cgi->writeInput();
 	}
 	else
 	{
-		sendErrorResponse(conn.fd, 500, "Internal Server Error", conn.server);
+		open = cgi->readOutput(conn.cache_key.empty() ? OUTPUT_HIGH_WATER : _cgi_cache.maxEntry());
 	}
-}
-
-void WebServer::handleDeleteRequest(ClientConnection &conn,
-									const HttpRequest &request, const LocationConfig &location)
-{
-	HttpResponse response;
-
-	std::string file_path = location._root;
-	if (file_path.empty())
+	if (!open)
 	{
-		file_path = "./www";
+		_cgi_fds.erase(pipe_fd);
+		removePollFd(pipe_fd);
 	}
-	std::string uri = urlDecode(request.getUri());
-	if (uri.find("../") != std::string::npos)
+	if (cgi->isComplete())
 	{
-		sendErrorResponse(conn.fd, 403, "Forbidden", conn.server);
-		return;
+		finishCGI(conn);
 	}
-	if (location._path != "/" && uri.find(location._path) == 0)
+	else
+	{
+		streamCGI(conn);
+	}
+}
+
+void WebServer::streamCGI(ClientConnection &conn)
+{
+	CGI *cgi = conn.cgi;
+
+	if (!conn.cache_key.empty())
 	{
-		if (uri == location._path)
+		if (cgi->getOutputSize() < _cgi_cache.maxEntry())
 		{
-			uri = "/";
+			return;
 		}
-		else if (uri.length() > location._path.length() && uri[location._path.length()] == '/')
+		_cgi_cache.pass(conn.cache_key, time(NULL));
+		releaseCacheLock(conn);
+		if (conn.fd < 0)
 		{
-			uri = uri.substr(location._path.length());
+			removeClient(conn.fd);
+			return;
 		}
 	}
-	if (location._path == "/uploads")
+	if (!conn.cgi_stream)
 	{
-		file_path = "www/uploads";
-		if (uri != "/")
+		if (cgi->getOutputFd() < 0 || !cgi->parseHead())
 		{
-			file_path += uri;
+			return;
 		}
-	}
-	else if (location._path == "/cgi-bin")
-	{
-		file_path = "www/cgi-bin";
-		if (uri != "/")
+		const HttpRequest &request = cgi->getRequest();
+		std::string head = cgi->getHead() + "\r\n";
+		std::string encoding;
+		bool chunked = !cgi->hasContentLength();
+		if (head.compare(0, 12, "HTTP/1.1 200") == 0 && request.getMethod() != "HEAD" &&
+			isCompressible(request, cgi->getLocation(), getHeaderValue(head, "content-type"), -1))
 		{
-			file_path += uri;
+			encoding = negotiateEncoding(request);
+			insertHeader(head, "Vary", "Accept-Encoding");
+			chunked = chunked || !encoding.empty();
 		}
+		if (chunked && request.getHttpVersion() != "HTTP/1.1")
+		{
+			chunked = false;
+			conn.close_after_write = true;
+		}
+		conn.cgi_stream = new StreamSource();
+		queueStream(conn, head, conn.cgi_stream, encoding, chunked);
 	}
-	else
+	conn.cgi_stream->append(cgi->takeOutput());
+	handleClientWrite(conn.fd);
+}
+
+void WebServer::throttleCGI(ClientConnection &conn)
+{
+	if (!conn.cgi || !conn.cgi_stream || conn.cgi->getOutputFd() < 0)
 	{
-		file_path += uri;
+		return;
 	}
-	if (!fileExists(file_path))
+	bool full = conn.out.size() - conn.out_offset + conn.cgi_stream->buffered() >= OUTPUT_HIGH_WATER;
+	if (full != conn.cgi_paused)
 	{
-		sendErrorResponse(conn.fd, 404, "Not Found", conn.server);
-		return;
+		conn.cgi_paused = full;
+		updatePollEvents(conn.cgi->getOutputFd(), full ? 0 : POLLIN);
 	}
-	if (isDirectory(file_path))
+}
+
+void WebServer::reapChildren()
+{
+	char drain[64];
+	pid_t pid;
+	int status;
+
+	while (read(g_signal_pipe[0], drain, sizeof(drain)) > 0)
 	{
-		sendErrorResponse(conn.fd, 403, "Forbidden", conn.server);
-		return;
 	}
-	if (!isWritable(file_path))
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
 	{
-		sendErrorResponse(conn.fd, 403, "Forbidden", conn.server);
+		std::map<pid_t, int>::iterator owner = _cgi_pids.find(pid);
+		if (owner == _cgi_pids.end())
+		{
+			continue;
+		}
+		std::map<int, ClientConnection>::iterator it = g_clients.find(owner->second);
+		_cgi_pids.erase(owner);
+		if (it == g_clients.end() || !it->second.cgi)
+		{
+			continue;
+		}
+		it->second.cgi->setExitStatus(status);
+		if (it->second.cgi->isComplete())
+		{
+			finishCGI(it->second);
+		}
+	}
+}
+
+void WebServer::finishCGI(ClientConnection &conn)
+{
+	CGI *cgi = conn.cgi;
+
+	unwatchCGI(cgi);
+	_fastcgi.cancel(cgi);
+	releaseCGISlot(cgi->getLocation());
+	conn.cgi_paused = false;
+	if (conn.cgi_stream)
+	{
+		if (cgi->hasFailed())
+		{
+			releaseBody(conn);
+			conn.close_after_write = true;
+		}
+		else
+		{
+			conn.cgi_stream->append(cgi->takeOutput());
+			conn.cgi_stream->close();
+		}
+		conn.cgi = NULL;
+		delete cgi;
+		handleClientWrite(conn.fd);
 		return;
 	}
-	if (unlink(file_path.c_str()) == 0)
+	std::string response = cgi->getResponse();
+	if (!conn.cache_key.empty())
 	{
-		response.setStatusCode(204);
-		sendResponse(conn.fd, response);
-		std::cout << "🗑️  Deleted: " << file_path << std::endl;
+		_cgi_cache.store(conn.cache_key, response, time(NULL));
+		releaseCacheLock(conn);
 	}
-	else
+	conn.cgi = NULL;
+	if (conn.fd < 0)
 	{
-		sendErrorResponse(conn.fd, 500, "Internal Server Error", conn.server);
+		std::map<int, ClientConnection>::iterator it = g_clients.find(conn.fd);
+		delete cgi;
+		eraseClient(it);
+		return;
 	}
+	deliverCGIResponse(conn, response, cgi->getRequest(), cgi->getLocation());
+	delete cgi;
+	handleClientWrite(conn.fd);
 }
 
-void WebServer::handleCGIRequest(ClientConnection &conn,
-								 const HttpRequest &request, const LocationConfig &location,
-								 const std::string &script_path)
+void WebServer::deliverCGIResponse(ClientConnection &conn, std::string response,
+								   const HttpRequest &request, const LocationConfig &location)
 {
-	std::cout << "🔧 Executing CGI: " << script_path << std::endl;
-	if (!fileExists(script_path))
+	size_t head_end = response.find("\r\n\r\n");
+	if (head_end != std::string::npos && response.compare(0, 12, "HTTP/1.1 200") == 0 &&
+		request.getMethod() != "HEAD")
+	{
+		std::string head = response.substr(0, head_end + 4);
+		std::string body = response.substr(head_end + 4);
+		if (isCompressible(request, location, getHeaderValue(head, "content-type"),
+						   body.length()))
+		{
+			std::string encoding = negotiateEncoding(request);
+			insertHeader(head, "Vary", "Accept-Encoding");
+			queueStream(conn, head, new StringSource(body), encoding, !encoding.empty());
+			response.clear();
+		}
+	}
+	conn.out += response;
+}
+
+void WebServer::syncFastCGI()
+{
+	std::vector<int> completed;
+	std::map<int, short> wanted;
+
+	for (_fastcgi.takeCompleted(completed); !completed.empty();
+		 _fastcgi.takeCompleted(completed))
 	{
-		std::cerr << "CGI Error: Script not found: " << script_path << std::endl;
-		sendErrorResponse(conn.fd, 404, "CGI Script Not Found", conn.server);
-		return;
+		for (size_t i = 0; i < completed.size(); i++)
+		{
+			std::map<int, ClientConnection>::iterator it = g_clients.find(completed[i]);
+			if (it != g_clients.end() && it->second.cgi && it->second.cgi->isComplete())
+			{
+				finishCGI(it->second);
+			}
+		}
 	}
-	if (!fileExists(location._cgi_path))
+	_fastcgi.pollFds(wanted);
+	for (std::map<int, short>::iterator it = _fastcgi_fds.begin(); it != _fastcgi_fds.end(); ++it)
 	{
-		std::cerr << "CGI Error: Interpreter not found: " << location._cgi_path << std::endl;
-		sendErrorResponse(conn.fd, 500, "CGI Interpreter Not Found",
-						  conn.server);
-		return;
+		if (!wanted.count(it->first))
+		{
+			removePollFd(it->first);
+		}
 	}
-	if (!isReadable(script_path))
+	for (std::map<int, short>::iterator it = wanted.begin(); it != wanted.end(); ++it)
 	{
-		std::cerr << "CGI Error: Script not readable: " << script_path << std::endl;
-		sendErrorResponse(conn.fd, 403, "CGI Script Not Readable", conn.server);
-		return;
+		std::map<int, short>::iterator known = _fastcgi_fds.find(it->first);
+		if (known == _fastcgi_fds.end())
+		{
+			struct pollfd pfd;
+			pfd.fd = it->first;
+			pfd.events = it->second;
+			pfd.revents = 0;
+			_poll_fds.push_back(pfd);
+		}
+		else if (known->second != it->second)
+		{
+			updatePollEvents(it->first, it->second);
+		}
 	}
-	CGI cgi(request, location);
-	std::string response = cgi.execute(script_path);
-	if (response.empty())
+	_fastcgi_fds.swap(wanted);
+}
+
+void WebServer::unwatchCGI(CGI *cgi)
+{
+	int fds[2] = {cgi->getInputFd(), cgi->getOutputFd()};
+
+	for (int i = 0; i < 2; i++)
 	{
-		sendErrorResponse(conn.fd, 500, "CGI Execution Failed", conn.server);
-		return;
+		if (fds[i] >= 0 && _cgi_fds.erase(fds[i]))
+		{
+			removePollFd(fds[i]);
+		}
 	}
-	send(conn.fd, response.c_str(), response.length(), 0);
 }
 
 void WebServer::handleFileUpload(ClientConnection &conn,
@@ -854,11 +2422,7 @@ void WebServer::handleFileUpload(ClientConnection &conn,
 	size_t content_end;
 
 	std::string content_type = request.getHeader("content-type");
-	std::string upload_path = location._upload_path;
-	if (upload_path.empty())
-	{
-		upload_path = "www/uploads";
-	}
+	const std::string &upload_path = location._upload_path;
 	if (!fileExists(upload_path))
 	{
 		mkdir(upload_path.c_str(), 0755);
@@ -951,25 +2515,84 @@ void WebServer::handleFileUpload(ClientConnection &conn,
 	}
 }
 
-void WebServer::serveStaticFile(int client_fd, const std::string &file_path,
-								bool head_only)
+void WebServer::serveStaticFile(ClientConnection &conn, int fd, const struct stat &info,
+								const std::string &file_path, const HttpRequest &request,
+								const LocationConfig &location)
 {
 	HttpResponse response;
+	struct stat source_info = info;
+	std::string encoding;
 
-	std::string content = readFile(file_path);
-	if (content.empty() && getFileSize(file_path) > 0)
+	if (location._gzip_static)
 	{
-		sendErrorResponse(client_fd, 500, "Failed to read file");
-		return;
+		std::string source_path = _sidecars.select(file_path, info,
+												   request.getHeader("accept-encoding"), encoding);
+		if (!encoding.empty())
+		{
+			close(fd);
+			fd = openResolved(location, source_path, O_RDONLY | O_CLOEXEC);
+			if (fd < 0 || fstat(fd, &source_info) != 0)
+			{
+				if (fd >= 0)
+				{
+					close(fd);
+				}
+				sendErrorResponse(conn.fd, 500, "Failed to read file", conn.server);
+				return;
+			}
+		}
 	}
+	std::string content_type = getMimeType(file_path);
 	response.setStatusCode(200);
-	if (!head_only)
+	response.addHeader("content-type", content_type);
+	response.addHeader("content-length", toString(source_info.st_size));
+	if (location._gzip_static)
 	{
-		response.setBody(content);
+		response.addHeader("vary", "Accept-Encoding");
 	}
-	response.addHeader("content-type", getMimeType(file_path));
-	response.addHeader("content-length", toString(content.length()));
-	sendResponse(client_fd, response);
+	if (!encoding.empty())
+	{
+		response.addHeader("content-encoding", encoding);
+	}
+	else if (isCompressible(request, location, content_type, source_info.st_size))
+	{
+		response.addHeader("vary", "Accept-Encoding");
+		encoding = negotiateEncoding(request);
+		if (!encoding.empty())
+		{
+			const std::string *cached = _compressed.find(file_path, encoding, source_info);
+			if (cached)
+			{
+				close(fd);
+				response.addHeader("content-encoding", encoding);
+				response.addHeader("content-length", toString(cached->length()));
+				queueStream(conn, response.serialize(),
+							request.getMethod() == "HEAD" ? NULL : new StringSource(*cached), "", false);
+				return;
+			}
+			if (request.getMethod() == "HEAD")
+			{
+				close(fd);
+				queueStream(conn, response.serialize(), NULL, encoding, true);
+				return;
+			}
+			BodyEncoder *fill = NULL;
+			if (static_cast<size_t>(source_info.st_size) <= _compressed.maxEntry())
+			{
+				fill = new CacheFillEncoder(_compressed, file_path, encoding, source_info);
+			}
+			queueStream(conn, response.serialize(), new FileSource(fd, source_info.st_size),
+						encoding, true, fill);
+			return;
+		}
+	}
+	if (request.getMethod() == "HEAD")
+	{
+		close(fd);
+		queueStream(conn, response.serialize(), NULL, "", false);
+		return;
+	}
+	queueStream(conn, response.serialize(), new FileSource(fd, source_info.st_size), "", false);
 }
 
 /* void WebServer::sendResponse(int client_fd, const HttpResponse &response)
@@ -1018,27 +2641,30 @@ void WebServer::serveStaticFile(int client_fd, const std::string &file_path,
 void WebServer::sendErrorResponse(int client_fd, int code,
 								  const std::string &message, const ServerConfig *server)
 {
-	HttpResponse response;
-
 	if (server)
 	{
-		std::map<int,
-				 std::string>::const_iterator it = server->_error_pages.find(code);
-		if (it != server->_error_pages.end())
+		std::map<std::pair<const ServerConfig *, int>,
+				 PrebuiltResponse>::const_iterator it = _error_pages.find(std::make_pair(server, code));
+		if (it != _error_pages.end())
 		{
-			std::string error_page = readFile(it->second);
-			if (!error_page.empty())
-			{
-				response.setStatusCode(code);
-				response.setBody(error_page);
-				response.addHeader("content-type", "text/html");
-				sendResponse(client_fd, response);
-				return;
-			}
+			Metrics::increment(it->second.metric);
+			queueData(client_fd, it->second.response);
+			return;
 		}
 	}
-	response.setError(code, message);
-	sendResponse(client_fd, response);
+	std::pair<int, std::string> key(code, message);
+	std::map<std::pair<int, std::string>, PrebuiltResponse>::iterator it = _fallback_errors.find(key);
+	if (it == _fallback_errors.end())
+	{
+		HttpResponse response;
+		response.setError(code, message);
+		PrebuiltResponse &prebuilt = _fallback_errors[key];
+		prebuilt.response = response.serialize();
+		prebuilt.metric = Metrics::label("webserv_error_responses_total", "code", toString(code));
+		it = _fallback_errors.find(key);
+	}
+	Metrics::increment(it->second.metric);
+	queueData(client_fd, it->second.response);
 }
 
 void WebServer::sendRedirectResponse(int client_fd, int code,
@@ -1059,11 +2685,64 @@ void WebServer::sendRedirectResponse(int client_fd, int code,
 
 void WebServer::removeClient(int client_fd)
 {
-	g_clients.erase(client_fd);
+	std::map<int, ClientConnection>::iterator it = g_clients.find(client_fd);
+	if (it != g_clients.end())
+	{
+		releaseBody(it->second);
+		closeSpool(it->second);
+		if (it->second.cgi_queued)
+		{
+			std::map<int, PendingCGI>::iterator pending = _pending_cgi.find(client_fd);
+			const LocationConfig &location = *pending->second.location;
+			std::deque<int> &queue = _cgi_queues[&location];
+			std::deque<int>::iterator queued = std::find(queue.begin(), queue.end(), client_fd);
+			dropPendingCGI(pending);
+			if (queued == queue.end())
+			{
+				releaseCGISlot(location);
+			}
+			else
+			{
+				queue.erase(queued);
+				Metrics::set(Metrics::label("webserv_cgi_queue_depth", "location", location._path),
+							 queue.size());
+			}
+		}
+		if (!it->second.cache_key.empty() && (it->second.cgi || it->second.cgi_queued))
+		{
+			releaseCacheLock(it->second);
+		}
+		else if (!it->second.cache_key.empty())
+		{
+			_cgi_cache.cancel(it->second.cache_key, client_fd);
+			std::map<int, PendingCGI>::iterator pending = _pending_cgi.find(client_fd);
+			if (pending != _pending_cgi.end())
+			{
+				dropPendingCGI(pending);
+			}
+		}
+		if (it->second.cgi)
+		{
+			unwatchCGI(it->second.cgi);
+			_fastcgi.cancel(it->second.cgi);
+			releaseCGISlot(it->second.cgi->getLocation());
+			delete it->second.cgi;
+		}
+		eraseClient(it);
+	}
+	if (client_fd < 0)
+	{
+		return;
+	}
 	close(client_fd);
+	removePollFd(client_fd);
+}
+
+void WebServer::removePollFd(int fd)
+{
 	for (std::vector<struct pollfd>::iterator it = _poll_fds.begin(); it != _poll_fds.end(); ++it)
 	{
-		if (it->fd == client_fd)
+		if (it->fd == fd)
 		{
 			_poll_fds.erase(it);
 			break;
@@ -1077,15 +2756,35 @@ void WebServer::checkTimeouts()
 
 	now = time(NULL);
 	std::vector<int> to_remove;
+	std::vector<int> expired;
 	for (std::map<int,
 				  ClientConnection>::iterator it = g_clients.begin();
 		 it != g_clients.end(); ++it)
 	{
-		if (now - it->second.last_activity > TIMEOUT_SECONDS)
+		if (it->second.cgi && !it->second.cgi_paused)
+		{
+			if (it->second.cgi->hasTimedOut(now))
+			{
+				expired.push_back(it->first);
+			}
+			continue;
+		}
+		if (now - it->second.last_activity > idleTimeout(it->second))
 		{
 			to_remove.push_back(it->first);
 		}
 	}
+	for (size_t i = 0; i < expired.size(); ++i)
+	{
+		std::map<int, ClientConnection>::iterator it = g_clients.find(expired[i]);
+		if (it != g_clients.end() && it->second.cgi)
+		{
+			std::cerr << "CGI timeout on connection " << expired[i] << std::endl;
+			unwatchCGI(it->second.cgi);
+			it->second.cgi->terminate();
+			finishCGI(it->second);
+		}
+	}
 	for (size_t i = 0; i < to_remove.size(); ++i)
 	{
 		std::cout << "⏱️  Timeout: closing connection " << to_remove[i] << std::endl;
@@ -1093,7 +2792,7 @@ void WebServer::checkTimeouts()
 	}
 }
 
-std::string WebServer::toString(int num)
+std::string WebServer::toString(long num)
 {
 	std::ostringstream oss;
 	oss << num;
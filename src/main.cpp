@@ -1,6 +1,7 @@
 
 #include "../inc/Config.hpp"
 #include "../inc/WebServer.hpp"
+#include "../inc/utils.hpp"
 #include <csignal>
 #include <cstdlib>
 #include <iostream>
@@ -12,11 +13,6 @@ void signalHandler(int signum)
 
 		return;
 	}
-	if (signum == SIGINT || signum == SIGTERM)
-	{
-		std::cout << "\n\n🛑 Shutting down webserv..." << std::endl;
-		exit(0);
-	}
 }
 
 void printUsage(const char *program)
@@ -40,6 +36,10 @@ void printServerInfo(const std::vector<ServerConfig> &servers)
 		std::cout << std::string(40, '-') << std::endl;
 		std::cout << "   Host: " << s._host << std::endl;
 		std::cout << "   Port: " << s._port << std::endl;
+		if (s._default_server)
+		{
+			std::cout << "   Default Server: yes" << std::endl;
+		}
 		if (!s._server_names.empty())
 		{
 			std::cout << "   Server Names: ";
@@ -52,6 +52,27 @@ void printServerInfo(const std::vector<ServerConfig> &servers)
 			std::cout << std::endl;
 		}
 		std::cout << "   Max Body Size: " << s._client_max_body_size << " bytes" << std::endl;
+		std::cout << "   Timeouts: header " << s._client_header_timeout << "s, body "
+				  << s._client_body_timeout << "s, send " << s._send_timeout << "s" << std::endl;
+		std::cout << "   Buffers: recv " << s._recv_buffer_size << ", header "
+				  << s._client_header_buffer_size << " bytes, backlog " << s._backlog << std::endl;
+		if (s._tcp_nodelay || s._tcp_nopush || s._defer_accept || s._fastopen || s._rcvbuf || s._sndbuf)
+		{
+			std::cout << "   Socket:";
+			if (s._tcp_nodelay)
+				std::cout << " tcp_nodelay";
+			if (s._tcp_nopush)
+				std::cout << " tcp_nopush";
+			if (s._defer_accept)
+				std::cout << " deferred=" << s._defer_accept << "s";
+			if (s._fastopen)
+				std::cout << " fastopen=" << s._fastopen;
+			if (s._rcvbuf)
+				std::cout << " rcvbuf=" << s._rcvbuf;
+			if (s._sndbuf)
+				std::cout << " sndbuf=" << s._sndbuf;
+			std::cout << std::endl;
+		}
 		if (!s._error_pages.empty())
 		{
 			std::cout << "   Error Pages: ";
@@ -69,7 +90,7 @@ void printServerInfo(const std::vector<ServerConfig> &servers)
 		for (size_t j = 0; j < s._locations.size(); ++j)
 		{
 			const LocationConfig &loc = s._locations[j];
-			std::cout << "      [" << loc._path << "]" << std::endl;
+			std::cout << "      [" << (loc._modifier.empty() ? "" : loc._modifier + " ") << loc._path << "]" << std::endl;
 			std::cout << "        Root: " << loc._root << std::endl;
 			if (!loc._allowed_methods.empty())
 			{
@@ -88,11 +109,52 @@ void printServerInfo(const std::vector<ServerConfig> &servers)
 			}
 			if (loc._directory_listing)
 			{
-				std::cout << "        Autoindex: on" << std::endl;
+				std::cout << "        Autoindex: on (" << loc._autoindex_format << ")" << std::endl;
+			}
+			if (loc._gzip_static)
+			{
+				std::cout << "        Gzip static: on" << std::endl;
+			}
+			if (loc._gzip)
+			{
+				std::cout << "        Gzip: on (min " << loc._gzip_min_length << " bytes)" << std::endl;
+			}
+			if (loc._metrics)
+			{
+				std::cout << "        Metrics: on" << std::endl;
 			}
 			if (!loc._cgi_path.empty())
 			{
-				std::cout << "        CGI: " << loc._cgi_path << " (" << loc._cgi_extension << ")" << std::endl;
+				std::cout << "        CGI: " << loc._cgi_path << " (" << loc._cgi_extension << ", timeout "
+						  << loc._cgi_timeout << "s)" << std::endl;
+			}
+			if (!loc._cgi_pool.empty())
+			{
+				std::cout << "        CGI pool: " << loc._cgi_pool << " (" << loc._cgi_pool_idle
+						  << " idle, " << loc._cgi_pool_max << " max, recycle after "
+						  << loc._cgi_pool_requests << ")" << std::endl;
+			}
+			if (!loc._handler_module.empty())
+			{
+				std::cout << "        Module: " << loc._handler_module << std::endl;
+			}
+			if (loc._cgi_max_concurrency > 0)
+			{
+				std::cout << "        CGI concurrency: " << loc._cgi_max_concurrency << " (queue "
+						  << loc._cgi_queue_size << ")" << std::endl;
+			}
+			if (loc._cgi_cache)
+			{
+				std::cout << "        CGI cache: on";
+				for (size_t k = 0; k < loc._cgi_cache_key_headers.size(); ++k)
+				{
+					std::cout << (k > 0 ? " " : " (key: ") << loc._cgi_cache_key_headers[k];
+				}
+				std::cout << (loc._cgi_cache_key_headers.empty() ? "" : ")") << std::endl;
+			}
+			if (!loc._fastcgi_pass.empty())
+			{
+				std::cout << "        FastCGI: " << loc._fastcgi_pass << " (" << loc._cgi_extension << ")" << std::endl;
 			}
 			if (!loc._upload_path.empty())
 			{
@@ -112,8 +174,6 @@ int main(int argc, char *argv[])
 {
 
 	signal(SIGPIPE, signalHandler);
-	signal(SIGINT, signalHandler);
-	signal(SIGTERM, signalHandler);
 	if (argc < 2) 
 	{
 		std::cerr << "Error: No configuration file" << std::endl;
@@ -156,7 +216,12 @@ int main(int argc, char *argv[])
 
 		printServerInfo(servers);
 
-		WebServer server(servers);
+		std::string executable = argv[0];
+		if (executable.find('/') == std::string::npos)
+		{
+			executable = "/proc/self/exe";
+		}
+		WebServer server(servers, absolutePath(config_file), absolutePath(executable));
 		server.run();
 	}
 	catch (const std::exception &e)
@@ -1,5 +1,11 @@
 
 #include "../inc/utils.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/openat2.h>
+#include <sys/syscall.h>
 
 bool isDirectory(const std::string &path)
 {
@@ -11,6 +17,41 @@ bool isDirectory(const std::string &path)
     return S_ISDIR(info.st_mode);
 }
 
+int openBeneath(int dir_fd, const char *path, int flags)
+{
+    struct open_how how;
+    static bool supported = true;
+
+    if (supported)
+    {
+        std::memset(&how, 0, sizeof(how));
+        how.flags = flags;
+        how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+        int fd = syscall(SYS_openat2, dir_fd, path, &how, sizeof(how));
+        if (fd >= 0 || (errno != ENOSYS && errno != EPERM))
+        {
+            return fd;
+        }
+        supported = false;
+        std::cerr << "Warning: openat2 unavailable (" << std::strerror(errno)
+                  << "), path resolution is no longer confined with RESOLVE_BENEATH" << std::endl;
+    }
+    return openat(dir_fd, path, flags);
+}
+
+std::string absolutePath(const std::string &path)
+{
+    char *resolved = realpath(path.c_str(), NULL);
+
+    if (!resolved)
+    {
+        return path;
+    }
+    std::string result(resolved);
+    free(resolved);
+    return result;
+}
+
 bool isFile(const std::string &path)
 {
     struct stat info;
@@ -80,121 +121,6 @@ bool writeFile(const std::string &path, const std::string &content)
     return true;
 }
 
-std::string generateDirectoryListing(const std::string &path, const std::string &uri)
-{
-    DIR *dir = opendir(path.c_str());
-    if (!dir)
-    {
-        return "";
-    }
-
-    std::ostringstream html;
-    html << "<!DOCTYPE html>\n";
-    html << "<html>\n";
-    html << "<head>\n";
-    html << "  <title>Index of " << uri << "</title>\n";
-    html << "  <style>\n";
-    html << "    body { font-family: monospace; margin: 20px; }\n";
-    html << "    h1 { font-size: 24px; }\n";
-    html << "    table { border-collapse: collapse; width: 100%; }\n";
-    html << "    th, td { padding: 8px 15px; text-align: left; }\n";
-    html << "    th { background-color: #f0f0f0; border-bottom: 2px solid #ddd; }\n";
-    html << "    tr:hover { background-color: #f5f5f5; }\n";
-    html << "    a { text-decoration: none; color: #0066cc; }\n";
-    html << "    a:hover { text-decoration: underline; }\n";
-    html << "    .dir { font-weight: bold; }\n";
-    html << "    .size { text-align: right; font-family: monospace; }\n";
-    html << "    .date { font-family: monospace; }\n";
-    html << "  </style>\n";
-    html << "</head>\n";
-    html << "<body>\n";
-    html << "  <h1>Index of " << uri << "</h1>\n";
-    html << "  <hr>\n";
-    html << "  <table>\n";
-    html << "    <thead>\n";
-    html << "      <tr>\n";
-    html << "        <th>Name</th>\n";
-    html << "        <th>Size</th>\n";
-    html << "        <th>Last Modified</th>\n";
-    html << "      </tr>\n";
-    html << "    </thead>\n";
-    html << "    <tbody>\n";
-
-    if (uri != "/")
-    {
-        html << "      <tr>\n";
-        html << "        <td><a href=\"../\" class=\"dir\">../</a></td>\n";
-        html << "        <td class=\"size\">-</td>\n";
-        html << "        <td class=\"date\">-</td>\n";
-        html << "      </tr>\n";
-    }
-
-    struct dirent *entry;
-    std::vector<std::string> entries;
-
-    while ((entry = readdir(dir)) != NULL)
-    {
-        std::string name = entry->d_name;
-
-        if (name[0] == '.')
-        {
-            continue;
-        }
-
-        entries.push_back(name);
-    }
-    closedir(dir);
-
-    std::sort(entries.begin(), entries.end());
-
-    for (std::vector<std::string>::const_iterator it = entries.begin();
-         it != entries.end(); ++it)
-    {
-
-        std::string entry_path = path + "/" + *it;
-        struct stat info;
-
-        if (stat(entry_path.c_str(), &info) == 0)
-        {
-            html << "      <tr>\n";
-
-            html << "        <td>";
-            if (S_ISDIR(info.st_mode))
-            {
-                html << "<a href=\"" << *it << "/\" class=\"dir\">" << *it << "/</a>";
-            }
-            else
-            {
-                html << "<a href=\"" << *it << "\">" << *it << "</a>";
-            }
-            html << "</td>\n";
-
-            html << "        <td class=\"size\">";
-            if (S_ISDIR(info.st_mode))
-            {
-                html << "-";
-            }
-            else
-            {
-                html << formatFileSize(info.st_size);
-            }
-            html << "</td>\n";
-
-            html << "        <td class=\"date\">" << formatTime(info.st_mtime) << "</td>\n";
-            html << "      </tr>\n";
-        }
-    }
-
-    html << "    </tbody>\n";
-    html << "  </table>\n";
-    html << "  <hr>\n";
-    html << "  <address>webserv/1.0 Server</address>\n";
-    html << "</body>\n";
-    html << "</html>\n";
-
-    return html.str();
-}
-
 std::string formatFileSize(size_t size)
 {
     std::ostringstream oss;
@@ -424,3 +350,90 @@ std::string join(const std::vector<std::string> &strings, const std::string &del
 
     return result;
 }
+
+bool acceptsEncoding(const std::string &header, const std::string &coding)
+{
+    std::vector<std::string> items = split(header, ',');
+    bool wildcard = false;
+
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        std::string item = trim(items[i]);
+        std::string name = item;
+        double quality = 1.0;
+        size_t semi = item.find(';');
+
+        if (semi != std::string::npos)
+        {
+            name = trim(item.substr(0, semi));
+            std::string param = trim(item.substr(semi + 1));
+            if (param.compare(0, 2, "q=") == 0)
+            {
+                quality = std::strtod(param.c_str() + 2, NULL);
+            }
+        }
+        name = toLowerCase(name);
+        if (name == coding)
+        {
+            return quality > 0.0;
+        }
+        if (name == "*")
+        {
+            wildcard = quality > 0.0;
+        }
+    }
+    return wildcard;
+}
+
+std::string htmlEscape(const std::string &str)
+{
+    std::string result;
+
+    for (size_t i = 0; i < str.length(); ++i)
+    {
+        switch (str[i])
+        {
+        case '&':
+            result += "&amp;";
+            break;
+        case '<':
+            result += "&lt;";
+            break;
+        case '>':
+            result += "&gt;";
+            break;
+        case '"':
+            result += "&quot;";
+            break;
+        default:
+            result += str[i];
+        }
+    }
+    return result;
+}
+
+std::string jsonEscape(const std::string &str)
+{
+    std::string result;
+    char buffer[8];
+
+    for (size_t i = 0; i < str.length(); ++i)
+    {
+        unsigned char c = str[i];
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+            result += c;
+        }
+        else if (c < 0x20)
+        {
+            snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            result += buffer;
+        }
+        else
+        {
+            result += c;
+        }
+    }
+    return result;
+}